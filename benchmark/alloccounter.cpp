@@ -0,0 +1,76 @@
+#include "alloccounter.h"
+#include <atomic>
+#include <cstddef>
+
+#if defined(__GLIBC__)
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void __libc_free(void *ptr);
+}
+
+static std::atomic<quint64> allocationCount(0);
+static std::atomic<quint64> allocationBytes(0);
+
+// определения в исполняемом файле перекрывают malloc для всех библиотек процесса, в том числе для Qt
+extern "C" void *malloc(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(count * size, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+bool AllocCounter::isAvailable()
+{
+    return true;
+}
+
+quint64 AllocCounter::allocations()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+quint64 AllocCounter::allocatedBytes()
+{
+    return allocationBytes.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool AllocCounter::isAvailable()
+{
+    return false;
+}
+
+quint64 AllocCounter::allocations()
+{
+    return 0;
+}
+
+quint64 AllocCounter::allocatedBytes()
+{
+    return 0;
+}
+
+#endif
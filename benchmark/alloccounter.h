@@ -0,0 +1,17 @@
+#ifndef ALLOCCOUNTER_H
+#define ALLOCCOUNTER_H
+
+#include <QtGlobal>
+
+// счетчик выделений памяти процесса: перехватывает malloc/calloc/realloc (glibc),
+// через них же идут operator new и буферы контейнеров Qt.
+// на других платформах счетчик всегда возвращает 0
+
+namespace AllocCounter
+{
+    bool isAvailable();
+    quint64 allocations();
+    quint64 allocatedBytes();                           // запрошено байт за все время (без учета освобождений)
+}
+
+#endif // ALLOCCOUNTER_H
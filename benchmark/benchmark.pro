@@ -0,0 +1,39 @@
+QT -= gui
+QT += network
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+LIBS += -lz
+
+INCLUDEPATH += ../server ../common
+
+SOURCES += \
+        alloccounter.cpp \
+        main.cpp \
+        ../common/binaryprotocol.cpp \
+        ../common/compression.cpp \
+        ../server/epollreactor.cpp \
+        ../server/framereader.cpp \
+        ../server/framewriter.cpp \
+        ../server/logger.cpp \
+        ../server/metrics.cpp \
+        ../server/serverworker.cpp \
+        ../server/sessionbacklog.cpp \
+        ../server/timerwheel.cpp \
+        ../server/tokenbucket.cpp
+
+HEADERS += \
+    alloccounter.h \
+    ../common/binaryprotocol.h \
+    ../common/compression.h \
+    ../server/epollreactor.h \
+    ../server/framereader.h \
+    ../server/framewriter.h \
+    ../server/logger.h \
+    ../server/metrics.h \
+    ../server/objectpool.h \
+    ../server/serverworker.h \
+    ../server/sessionbacklog.h \
+    ../server/timerwheel.h \
+    ../server/tokenbucket.h
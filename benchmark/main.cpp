@@ -0,0 +1,379 @@
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include "alloccounter.h"
+#include "framereader.h"
+#include "framewriter.h"
+#include "serverworker.h"
+#include "tokenbucket.h"
+
+#ifdef Q_OS_LINUX
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// замер стоимости сериализации одного broadcast в зависимости от количества клиентов:
+// perClient - старый путь (json кодируется заново для каждого клиента),
+// shared - новый путь (один фрейм, всем клиентам уходит разделяемый буфер).
+// вторая таблица - стоимость разбора входящих фреймов на сообщение:
+// stream - старый путь (транзакция QDataStream, новый QByteArray на каждый фрейм),
+// reader - FrameReader (фреймы разбираются прямо в буфере соединения).
+// третья таблица - сборка исходящего сообщения чата (json и бинарный фрейм) и создание/удаление воркера:
+// json - QJsonObject + encodeJson, writer - FrameWriter в буфере потока;
+// session - только объект воркера, connection - воркер с принятым tcp-соединением (QTcpSocket и буфер чтения)
+// последняя строка - проверка общего лимита: несколько потоков списывают одно ведро, пропущенное не должно
+// превышать rate * время + burst (при ошибке программа завершается с кодом 1)
+
+static QJsonObject makeMessage()
+{
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("message");
+    message[QStringLiteral("text")] = QStringLiteral("Lorem ipsum dolor sit amet, consectetur adipiscing elit");
+    message[QStringLiteral("sender")] = QStringLiteral("benchmark");
+    return message;
+}
+
+static qint64 perClientBroadcast(const QJsonObject &message, QVector<QByteArray> &outboxes, qint64 &encodeNs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (QByteArray &outbox : outboxes)
+        outbox = ServerWorker::encodeJson(message);
+    encodeNs = timer.nsecsElapsed();
+    return encodeNs;
+}
+
+static qint64 sharedBroadcast(const QJsonObject &message, QVector<QByteArray> &outboxes, qint64 &encodeNs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    const QByteArray frame = ServerWorker::encodeJson(message);
+    encodeNs = timer.nsecsElapsed();
+    for (QByteArray &outbox : outboxes)
+        outbox = frame;
+    return timer.nsecsElapsed();
+}
+
+// входящий поток: фреймы приходят кусками фиксированного размера, как из сокета
+static QVector<QByteArray> makeChunks(const QJsonObject &message, int frames, int chunkSize)
+{
+    QByteArray stream;
+    const QByteArray frame = ServerWorker::encodeJson(message);
+    for (int i = 0; i < frames; ++i)
+        stream.append(frame);
+
+    QVector<QByteArray> chunks;
+    for (int offset = 0; offset < stream.size(); offset += chunkSize)
+        chunks.append(stream.mid(offset, chunkSize));
+    return chunks;
+}
+
+static int streamReceive(const QVector<QByteArray> &chunks, qint64 &elapsedNs, quint64 &allocations)
+{
+    QBuffer device;
+    device.open(QIODevice::ReadWrite);
+    QDataStream socketStream(&device);
+    int frames = 0;
+    qint64 checksum = 0;
+
+    QElapsedTimer timer;
+    const quint64 allocationsBefore = AllocCounter::allocations();
+    timer.start();
+    for (const QByteArray &chunk : chunks)
+    {
+        // дописываем кусок в конец и читаем с прежней позиции
+        const qint64 position = device.pos();
+        device.seek(device.size());
+        device.write(chunk);
+        device.seek(position);
+
+        QByteArray frame;
+        while (true)
+        {
+            socketStream.startTransaction();
+            socketStream >> frame;
+            if (!socketStream.commitTransaction())
+                break;
+            checksum += frame.size();
+            ++frames;
+        }
+    }
+    elapsedNs = timer.nsecsElapsed();
+    allocations = AllocCounter::allocations() - allocationsBefore;
+    return checksum > 0 ? frames : 0;
+}
+
+static int readerReceive(const QVector<QByteArray> &chunks, qint64 &elapsedNs, quint64 &allocations)
+{
+    FrameReader reader;
+    int frames = 0;
+    qint64 checksum = 0;
+
+    QElapsedTimer timer;
+    const quint64 allocationsBefore = AllocCounter::allocations();
+    timer.start();
+    for (const QByteArray &chunk : chunks)
+    {
+        reader.append(chunk.constData(), chunk.size());
+
+        const char *data = nullptr;
+        int size = 0;
+        while (reader.nextFrame(data, size))
+        {
+            checksum += size;
+            ++frames;
+        }
+    }
+    elapsedNs = timer.nsecsElapsed();
+    allocations = AllocCounter::allocations() - allocationsBefore;
+    return checksum > 0 ? frames : 0;
+}
+
+// замер выделений памяти: время, количество и байты на одну итерацию
+struct AllocStats
+{
+    double ns;
+    double allocations;
+    double bytes;
+};
+
+template <typename Body>
+static AllocStats measure(int iterations, Body body)
+{
+    QElapsedTimer timer;
+    const quint64 allocationsBefore = AllocCounter::allocations();
+    const quint64 bytesBefore = AllocCounter::allocatedBytes();
+    timer.start();
+    for (int i = 0; i < iterations; ++i)
+        body(i);
+    const qint64 elapsed = timer.nsecsElapsed();
+    return { double(elapsed) / iterations,
+             double(AllocCounter::allocations() - allocationsBefore) / iterations,
+             double(AllocCounter::allocatedBytes() - bytesBefore) / iterations };
+}
+
+static void printStats(QTextStream &out, const char *name, const AllocStats &stats)
+{
+    out << name << '\t' << stats.ns << '\t' << stats.allocations << '\t' << stats.bytes << '\n';
+}
+
+static QByteArray jsonChatFrame(const QString &sender, const QString &text, int seq, QByteArray &binaryFrame)
+{
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("message");
+    message[QStringLiteral("text")] = text;
+    message[QStringLiteral("sender")] = sender;
+    message[QStringLiteral("senderid")] = 1.0;
+    message[QStringLiteral("seq")] = double(seq);
+    message[QStringLiteral("time")] = 1700000000000.0;
+    binaryFrame = ServerWorker::encodeBinary(message);
+    return ServerWorker::encodeJson(message);
+}
+
+static QByteArray writerChatFrame(const QString &sender, const QString &text, int seq, QByteArray &binaryFrame)
+{
+    FrameWriter message;
+    message.add(QLatin1String("type"), QLatin1String("message"))
+           .add(QLatin1String("text"), text)
+           .add(QLatin1String("sender"), sender)
+           .add(QLatin1String("senderid"), qint64(1))
+           .add(QLatin1String("seq"), qint64(seq))
+           .add(QLatin1String("time"), qint64(1700000000000));
+    binaryFrame = ServerWorker::encodeFrame(BinaryProtocol::encode(BinaryProtocol::ChatMessage, 1, BinaryProtocol::encodeChat(sender, text)));
+    return message.frame();
+}
+
+#ifdef Q_OS_LINUX
+// слушающий сокет на loopback и соединения к нему без Qt: в замер попадают только выделения серверной стороны
+static int listenLoopback(sockaddr_in &address)
+{
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    socklen_t length = sizeof(address);
+    address = sockaddr_in();
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(fd, 128) < 0
+        || ::getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int connectLoopback(const sockaddr_in &address)
+{
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+// все потоки ввода-вывода списывают общее ведро одновременно, как admitFrame
+static bool globalBucketHolds(QTextStream &out, int threads, qint64 durationMs)
+{
+    const double rate = 100000;
+    const double burst = 1000;
+    TokenBucket bucket;
+    bucket.configure(rate, burst);
+
+    QVector<quint64> admitted(threads, 0);
+    QVector<QThread *> workers;
+    const qint64 startNs = TokenBucket::now();
+    const qint64 stopNs = startNs + durationMs * 1000000;
+    for (int i = 0; i < threads; ++i)
+    {
+        quint64 *count = &admitted[i];
+        workers.append(QThread::create([&bucket, count, stopNs]() {
+            for (qint64 now = TokenBucket::now(); now < stopNs; now = TokenBucket::now())
+            {
+                if (bucket.tryTake(now, 1) == 0)
+                    ++*count;
+            }
+        }));
+        workers.last()->start();
+    }
+    for (QThread *worker : qAsConst(workers))
+    {
+        worker->wait();
+        delete worker;
+    }
+    const qint64 elapsedNs = TokenBucket::now() - startNs;
+
+    quint64 total = 0;
+    for (quint64 count : qAsConst(admitted))
+        total += count;
+    const quint64 limit = quint64(double(elapsedNs) * rate / 1e9 + burst) + 1;
+    out << "global bucket\t" << threads << " threads\t" << total << " admitted\t" << limit << " allowed\n";
+    return total <= limit;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+
+    const QJsonObject message = makeMessage();
+    const int rounds = 200;
+    const QVector<int> clientCounts = {1, 10, 100, 1000, 2000, 5000};
+
+    out << "clients\tperClient encode us\tperClient total us\tshared encode us\tshared total us\n";
+    for (int clients : clientCounts)
+    {
+        QVector<QByteArray> outboxes(clients);
+        qint64 perClientEncode = 0, perClientTotal = 0, sharedEncode = 0, sharedTotal = 0;
+
+        for (int i = 0; i < rounds; ++i)
+        {
+            qint64 encodeNs = 0;
+            perClientTotal += perClientBroadcast(message, outboxes, encodeNs);
+            perClientEncode += encodeNs;
+            sharedTotal += sharedBroadcast(message, outboxes, encodeNs);
+            sharedEncode += encodeNs;
+        }
+
+        out << clients << '\t'
+            << double(perClientEncode) / rounds / 1000.0 << '\t'
+            << double(perClientTotal) / rounds / 1000.0 << '\t'
+            << double(sharedEncode) / rounds / 1000.0 << '\t'
+            << double(sharedTotal) / rounds / 1000.0 << '\n';
+    }
+
+    const int frames = 100000;
+    out << "\nchunk bytes\tstream ns/msg\tstream allocs/msg\treader ns/msg\treader allocs/msg\n";
+    for (int chunkSize : {64, 1460, 16384, 65536})
+    {
+        const QVector<QByteArray> chunks = makeChunks(message, frames, chunkSize);
+        qint64 streamNs = 0, readerNs = 0;
+        quint64 streamAllocs = 0, readerAllocs = 0;
+        const int streamFrames = streamReceive(chunks, streamNs, streamAllocs);
+        const int readerFrames = readerReceive(chunks, readerNs, readerAllocs);
+        if (streamFrames != frames || readerFrames != frames)
+        {
+            out << "frame count mismatch\n";
+            return 1;
+        }
+
+        out << chunkSize << '\t'
+            << double(streamNs) / frames << '\t'
+            << double(streamAllocs) / frames << '\t'
+            << double(readerNs) / frames << '\t'
+            << double(readerAllocs) / frames << '\n';
+    }
+    const int messages = 100000;
+    const QString sender = QStringLiteral("benchmark");
+    const QString text = message.value(QLatin1String("text")).toString();
+    qint64 checksum = 0;
+    out << "\nmessage\tns/msg\tallocs/msg\tbytes/msg\n";
+    printStats(out, "json", measure(messages, [&](int i) {
+        QByteArray binaryFrame;
+        checksum += jsonChatFrame(sender, text, i, binaryFrame).size() + binaryFrame.size();
+    }));
+    printStats(out, "writer", measure(messages, [&](int i) {
+        QByteArray binaryFrame;
+        checksum += writerChatFrame(sender, text, i, binaryFrame).size() + binaryFrame.size();
+    }));
+
+    // воркеры берутся из пула: после первого круга блоки под ServerWorker не выделяются заново
+    const int sessions = 10000;
+    printStats(out, "session", measure(sessions, [&](int) {
+        delete new ServerWorker;
+    }));
+
+#ifdef Q_OS_LINUX
+    // соединение целиком, как в Qt-бэкенде сервера: воркер, QTcpSocket с приватными данными, буфер чтения
+    sockaddr_in address;
+    const int listenFd = listenLoopback(address);
+    if (listenFd >= 0)
+    {
+        const int connections = 2000;
+        int failed = 0;
+        printStats(out, "connection", measure(connections, [&](int) {
+            const int clientFd = connectLoopback(address);
+            const int serverFd = clientFd >= 0 ? ::accept(listenFd, nullptr, nullptr) : -1;
+            ServerWorker *worker = new ServerWorker;
+            if (serverFd < 0)
+                ++failed;
+            else if (!worker->setSocketDescriptor(serverFd))
+            {
+                ++failed;
+                ::close(serverFd);
+            }
+            delete worker;                                  // сокет Qt закрывает дескриптор вместе с воркером
+            if (clientFd >= 0)
+                ::close(clientFd);
+        }));
+        ::close(listenFd);
+        if (failed > 0)
+            out << failed << " connections failed\n";
+    }
+#endif
+    if (checksum == 0)
+        return 1;
+
+    out << '\n';
+    if (!globalBucketHolds(out, qMax(2, QThread::idealThreadCount()), 200))
+    {
+        out << "global rate limit exceeded\n";
+        return 1;
+    }
+
+    if (!AllocCounter::isAvailable())
+        out << "allocation counting is not available on this platform\n";
+
+    return 0;
+}
@@ -0,0 +1,11 @@
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    benchmark \
+    client \
+    clientlib \
+    loadgen \
+    server
+
+client.depends = clientlib
+loadgen.depends = clientlib
@@ -0,0 +1,134 @@
+#include "chatmodel.h"
+#include <QBrush>
+#include <QFont>
+#include <QTimer>
+
+// строки, пришедшие за один кадр, добавляются в модель одной вставкой
+static const int FlushIntervalMs = 16;
+
+ChatModel::ChatModel(int capacity, QObject *parent)
+    : QAbstractListModel(parent)
+    , _capacity(qMax(1, capacity))
+    , _head(0)
+    , _count(0)
+    , _flushTimer(new QTimer(this))
+{
+    _flushTimer->setSingleShot(true);
+    _flushTimer->setInterval(FlushIntervalMs);
+    connect(_flushTimer, &QTimer::timeout, this, &ChatModel::flush);
+}
+
+int ChatModel::capacity() const
+{
+    return _capacity;
+}
+
+void ChatModel::setCapacity(int capacity)
+{
+    capacity = qMax(1, capacity);
+    if (capacity == _capacity)
+        return;
+
+    // перекладываем последние строки в новое кольцо с начала
+    beginResetModel();
+    QVector<Entry> ring;
+    const int keep = qMin(_count, capacity);
+    ring.reserve(keep);
+    for (int row = _count - keep; row < _count; ++row)
+        ring.append(entry(row));
+    _ring = ring;
+    _capacity = capacity;
+    _head = 0;
+    _count = keep;
+    endResetModel();
+}
+
+void ChatModel::append(Kind kind, const QString &text, Qt::GlobalColor color)
+{
+    _pending.append({ text, quint8(kind), quint8(color) });
+    if (!_flushTimer->isActive())
+        _flushTimer->start();
+}
+
+int ChatModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : _count;
+}
+
+QVariant ChatModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= _count)
+        return QVariant();
+
+    const Entry &item = entry(index.row());
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        return item.text;
+
+    case Qt::TextAlignmentRole:
+        if (item.kind == Own)
+            return int(Qt::AlignRight | Qt::AlignVCenter);
+        if (item.kind == Notice)
+            return int(Qt::AlignCenter);
+        return int(Qt::AlignLeft | Qt::AlignVCenter);
+
+    case Qt::FontRole:
+        if (item.kind == Nickname || item.kind == Direct)
+        {
+            QFont font;
+            font.setBold(item.kind == Nickname);
+            font.setItalic(item.kind == Direct);
+            return font;
+        }
+        return QVariant();
+
+    case Qt::ForegroundRole:
+        if (item.kind == Notice)
+            return QBrush(Qt::GlobalColor(item.color));
+        return QVariant();
+
+    default:
+        return QVariant();
+    }
+}
+
+void ChatModel::flush()
+{
+    if (_pending.isEmpty())
+        return;
+
+    // в пачке больше строк, чем вмещает лента, - самые старые из пачки не показываем
+    if (_pending.size() > _capacity)
+        _pending.erase(_pending.begin(), _pending.begin() + (_pending.size() - _capacity));
+
+    // вытесняем старые строки одним удалением
+    const int overflow = _count + _pending.size() - _capacity;
+    if (overflow > 0)
+    {
+        beginRemoveRows(QModelIndex(), 0, overflow - 1);
+        _head = (_head + overflow) % _capacity;
+        _count -= overflow;
+        endRemoveRows();
+    }
+
+    beginInsertRows(QModelIndex(), _count, _count + _pending.size() - 1);
+    for (Entry &item : _pending)
+    {
+        const int slot = (_head + _count) % _capacity;
+        if (slot < _ring.size())
+            _ring[slot] = std::move(item);
+        else
+            _ring.append(std::move(item));
+        ++_count;
+    }
+    endInsertRows();
+    _pending.clear();
+
+    emit rowsFlushed();
+}
+
+const ChatModel::Entry &ChatModel::entry(int row) const
+{
+    return _ring.at((_head + row) % _capacity);
+}
@@ -0,0 +1,61 @@
+#ifndef CHATMODEL_H
+#define CHATMODEL_H
+
+#include <QAbstractListModel>
+#include <QVector>
+
+class QTimer;
+
+// лента чата: кольцо из не более чем capacity строк (старые строки вытесняются),
+// новые строки копятся и добавляются в модель одной пачкой раз в кадр
+
+class ChatModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(ChatModel)
+
+public:
+    // вид строки определяет выравнивание, шрифт и цвет
+    enum Kind : quint8
+    {
+        Nickname,               // ник автора перед серией его сообщений, жирный
+        Message,                // входящее сообщение, слева
+        Own,                    // свое сообщение, справа
+        Direct,                 // личное сообщение, курсив
+        Notice                  // служебная строка по центру, цветом
+    };
+
+    explicit ChatModel(int capacity = 5000, QObject *parent = nullptr);
+
+    int capacity() const;
+    void setCapacity(int capacity);
+    void append(Kind kind, const QString &text, Qt::GlobalColor color = Qt::black);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+signals:
+    void rowsFlushed();                                 // пачка строк добавлена в модель
+
+private slots:
+    void flush();
+
+private:
+    struct Entry
+    {
+        QString text;
+        quint8 kind;
+        quint8 color;                                   // Qt::GlobalColor для Notice
+    };
+
+    const Entry &entry(int row) const;
+
+    QVector<Entry> _ring;                               // растет до _capacity, затем перезаписывается по кругу
+    int _capacity;
+    int _head;                                          // индекс первой строки в кольце
+    int _count;
+    QVector<Entry> _pending;                            // строки, ждущие следующего кадра
+    QTimer *_flushTimer;
+};
+
+#endif // CHATMODEL_H
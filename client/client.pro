@@ -8,18 +8,34 @@ CONFIG += c++11
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+INCLUDEPATH += ../clientlib ../common
+DEPENDPATH += ../clientlib ../common
+
 SOURCES += \
-    client.cpp \
+    chatmodel.cpp \
     clientwindow.cpp \
     main.cpp
 
 HEADERS += \
-    client.h \
+    chatmodel.h \
     clientwindow.h
 
 FORMS += \
     clientwindow.ui
 
+# клиентская библиотека (../clientlib), собирается отдельным подпроектом
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../clientlib/release/ -lclientlib
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../clientlib/debug/ -lclientlib
+else:unix: LIBS += -L$$OUT_PWD/../clientlib/ -lclientlib
+
+win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../clientlib/release/libclientlib.a
+else:win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../clientlib/debug/libclientlib.a
+else:win32:!win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../clientlib/release/clientlib.lib
+else:win32:!win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../clientlib/debug/clientlib.lib
+else:unix: PRE_TARGETDEPS += $$OUT_PWD/../clientlib/libclientlib.a
+
+LIBS += -lz
+
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
@@ -1,31 +1,50 @@
 #include "clientwindow.h"
 #include "ui_clientwindow.h"
 #include "client.h"
-#include "QStandardItemModel"
+#include "chatmodel.h"
 #include "QHostAddress"
 #include "QMessageBox"
 #include "QInputDialog"
+#include "QTimer"
+
+// сколько последних строк держит лента чата
+static const int ChatHistoryLimit = 5000;
+
+// пауза перед переподключением после обрыва, мс
+static const int ReconnectDelayMs = 1000;
 
 ClientWindow::ClientWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::ClientWindow)
     , _client(new Client(this))
-    , _chatModel(new QStandardItemModel(this))
+    , _chatModel(new ChatModel(ChatHistoryLimit, this))
 {
     ui->setupUi(this);
 
-    _chatModel->insertColumn(0);
+    // все строки ленты одной высоты - представление не измеряет каждую строку и рисует только видимые
+    ui->messagesView->setUniformItemSizes(true);
     ui->messagesView->setModel(_chatModel);
+    connect(_chatModel, &ChatModel::rowsFlushed, ui->messagesView, &QListView::scrollToBottom);
 
     // коннекты сигналов между классом клиент и окном клиента
     connect(_client, &Client::connected, this, &ClientWindow::connectedToServer);
     connect(_client, &Client::loggedIn, this, &ClientWindow::loggedIn);
+    connect(_client, &Client::sessionResumed, this, &ClientWindow::sessionResumed);
     connect(_client, &Client::loginError, this, &ClientWindow::loginFailed);
     connect(_client, &Client::messageReceived, this, &ClientWindow::messageReceived);
+    connect(_client, &Client::directMessageReceived, this, &ClientWindow::directMessageReceived);
+    connect(_client, &Client::directMessageFailed, this, &ClientWindow::directMessageFailed);
+    connect(_client, &Client::roomMessageReceived, this, &ClientWindow::roomMessageReceived);
+    connect(_client, &Client::roomJoined, this, &ClientWindow::roomJoined);
+    connect(_client, &Client::roomLeft, this, &ClientWindow::roomLeft);
+    connect(_client, &Client::roomUserJoined, this, &ClientWindow::roomUserJoined);
+    connect(_client, &Client::roomUserLeft, this, &ClientWindow::roomUserLeft);
+    connect(_client, &Client::messagesDropped, this, &ClientWindow::messagesDropped);
     connect(_client, &Client::disconnected, this, &ClientWindow::disconnectedFromServer);
     connect(_client, &Client::error, this, &ClientWindow::error);
     connect(_client, &Client::userJoined, this, &ClientWindow::userJoined);
     connect(_client, &Client::userLeft, this, &ClientWindow::userLeft);
+    connect(_client, &Client::rosterReceived, this, &ClientWindow::rosterReceived);
 
     // коннекты для gui
     connect(ui->pb_connect, &QPushButton::clicked, this, &ClientWindow::attemptConnection);
@@ -35,6 +54,9 @@ ClientWindow::ClientWindow(QWidget *parent)
 
 ClientWindow::~ClientWindow()
 {
+    // окно закрыто - выходим, чтобы сервер не держал сессию для восстановления
+    disconnect(_client, nullptr, this, nullptr);
+    _client->disconnectFromHost();
     delete ui;
 }
 
@@ -47,6 +69,10 @@ void ClientWindow::attemptConnection()
 
 void ClientWindow::connectedToServer()
 {
+    // переподключение после обрыва - сессия восстанавливается без ввода никнейма
+    if (_client->canResume())
+        return _client->resumeSession();
+
     // соединение установлено - запрос ввода никнейма
 
     const QString newNickname = QInputDialog::getText(this, tr("Input your nickname"), tr("nickname"));
@@ -74,6 +100,11 @@ void ClientWindow::loggedIn()
     _lastNickname.clear(); // очищаем информацию о никнейме, кто писал последним
 }
 
+void ClientWindow::sessionResumed()
+{
+    appendNotice(tr("connection restored"), Qt::darkGreen);
+}
+
 void ClientWindow::loginFailed(const QString &reason)
 {
     // Ошибка логина - снова запрос никнейма
@@ -86,8 +117,6 @@ void ClientWindow::messageReceived(const QString &sender, const QString &text)
 {
     // пришло сообщение
 
-    int newRow = _chatModel->rowCount();
-
     // если пришло сообщение от пользователя, отличного от того, который написал последнее сообщение
     // меняем значение _lastNickname для красивого вывода на экран
     if (_lastNickname != sender)
@@ -95,41 +124,126 @@ void ClientWindow::messageReceived(const QString &sender, const QString &text)
         _lastNickname = sender; // теперь пишет другой пользователь
 
         // выводим никнейм пользователя
-        QFont boldFont;
-        boldFont.setBold(true);
-        _chatModel->insertRows(newRow, 2);
-        _chatModel->setData(_chatModel->index(newRow, 0), sender + QLatin1Char(':'));
-        _chatModel->setData(_chatModel->index(newRow, 0), int(Qt::AlignLeft | Qt::AlignVCenter), Qt::TextAlignmentRole);
-        _chatModel->setData(_chatModel->index(newRow, 0), boldFont, Qt::FontRole);
-        ++newRow;
-    }
-    else
-    {
-        // продолжает писать тот же пользователь
-        _chatModel->insertRow(newRow);
+        _chatModel->append(ChatModel::Nickname, sender + QLatin1Char(':'));
     }
 
-    // печатаем сообщение слева на экране и пролистываем экран вниз
-    _chatModel->setData(_chatModel->index(newRow, 0), text);
-    _chatModel->setData(_chatModel->index(newRow, 0), int(Qt::AlignLeft | Qt::AlignVCenter), Qt::TextAlignmentRole);
-    ui->messagesView->scrollToBottom();
+    // печатаем сообщение слева на экране, экран пролистается вниз после добавления пачки строк
+    _chatModel->append(ChatModel::Message, text);
+}
+
+
+void ClientWindow::directMessageReceived(const QString &sender, const QString &text)
+{
+    // пришло личное сообщение - выводим его слева курсивом вместе с ником отправителя
+
+    _chatModel->append(ChatModel::Direct, tr("%1 (private): %2").arg(sender, text));
+
+    _lastNickname.clear();
+}
+
+void ClientWindow::directMessageFailed(const QString &to, const QString &reason)
+{
+    // личное сообщение не доставлено
+    appendNotice(tr("message to %1 was not delivered: %2").arg(to, reason), Qt::red);
+}
+
+void ClientWindow::roomMessageReceived(const QString &room, const QString &sender, const QString &text)
+{
+    // сообщение из комнаты выводим слева вместе с именем комнаты и ником отправителя
+
+    _chatModel->append(ChatModel::Message, tr("[%1] %2: %3").arg(room, sender, text));
+
+    _lastNickname.clear();
+}
+
+void ClientWindow::roomJoined(const QString &room)
+{
+    appendNotice(tr("you joined [%1]").arg(room), Qt::darkGreen);
+}
+
+void ClientWindow::roomLeft(const QString &room)
+{
+    appendNotice(tr("you left [%1]").arg(room), Qt::darkGreen);
+}
+
+void ClientWindow::roomUserJoined(const QString &room, const QString &nickname)
+{
+    appendNotice(tr("[%1] %2 joined").arg(room, nickname), Qt::blue);
+}
+
+void ClientWindow::roomUserLeft(const QString &room, const QString &nickname)
+{
+    appendNotice(tr("[%1] %2 left").arg(room, nickname), Qt::red);
+}
+
+void ClientWindow::messagesDropped(int count)
+{
+    appendNotice(tr("%n message(s) were skipped by the server", nullptr, count), Qt::darkYellow);
+}
+
+void ClientWindow::appendNotice(const QString &text, Qt::GlobalColor color)
+{
+    _chatModel->append(ChatModel::Notice, text, color);
+
+    _lastNickname.clear();
 }
 
 
 void ClientWindow::sendMessage()
 {
-    // записываем сообщение в сокет
-    _client->sendMessage(ui->le_message->text());
+    QString text = ui->le_message->text();
+
+    // команды "/join комната" и "/leave комната" - вход в комнату и выход из нее
+    if (text.startsWith(QLatin1String("/join ")) || text.startsWith(QLatin1String("/leave ")))
+    {
+        const int space = text.indexOf(QLatin1Char(' '));
+        const QString room = text.mid(space + 1).trimmed();
+        if (text.startsWith(QLatin1String("/join ")))
+            _client->joinRoom(room);
+        else
+            _client->leaveRoom(room);
+        ui->le_message->clear();
+        return;
+    }
+
+    // команда "/room комната текст" - сообщение в комнату
+    if (text.startsWith(QLatin1String("/room ")))
+    {
+        const QString args = text.mid(6).trimmed();
+        const int space = args.indexOf(QLatin1Char(' '));
+        if (space <= 0)
+            return;
+
+        const QString room = args.left(space);
+        const QString roomText = args.mid(space + 1).trimmed();
+        _client->sendRoomMessage(room, roomText);
+        text = tr("[%1] %2").arg(room, roomText);
+    }
+
+    // команда "/msg ник текст" - личное сообщение, иначе сообщение всем
+    else if (text.startsWith(QLatin1String("/msg ")))
+    {
+        const QString args = text.mid(5).trimmed();
+        const int space = args.indexOf(QLatin1Char(' '));
+        if (space <= 0)
+            return;
+
+        const QString to = args.left(space);
+        const QString directText = args.mid(space + 1).trimmed();
+        _client->sendDirectMessage(to, directText);
+        text = tr("to %1: %2").arg(to, directText);
+    }
+    else
+    {
+        // записываем сообщение в сокет
+        _client->sendMessage(text);
+    }
 
     // выводим сообщение справа на экране
-    const int newRow = _chatModel->rowCount();
-    _chatModel->insertRow(newRow);
-    _chatModel->setData(_chatModel->index(newRow, 0), ui->le_message->text());
-    _chatModel->setData(_chatModel->index(newRow, 0), int(Qt::AlignRight | Qt::AlignVCenter), Qt::TextAlignmentRole);
+    _chatModel->append(ChatModel::Own, text);
 
-    // очищаем поле для ввода и пролистываем экран вниз
+    // очищаем поле для ввода
     ui->le_message->clear();
-    ui->messagesView->scrollToBottom();
 
     _lastNickname.clear(); // очищаем ник предыдущего отправителя
 }
@@ -137,7 +251,17 @@ void ClientWindow::sendMessage()
 void ClientWindow::disconnectedFromServer()
 {
     // пропало соединение с сервером
-    // вывод сообщения и настраиваем gui
+    // сессию можно восстановить - сразу переподключаемся, пропущенные сообщения дошлет сервер
+    if (_client->canResume())
+    {
+        appendNotice(tr("connection lost, reconnecting..."), Qt::darkYellow);
+        ui->pb_send->setEnabled(false);
+        ui->le_message->setEnabled(false);
+        QTimer::singleShot(ReconnectDelayMs, this, &ClientWindow::attemptConnection);
+        return;
+    }
+
+    // иначе вывод сообщения и настраиваем gui
 
     QMessageBox::warning(this, tr("Disconnected"), tr("The host terminated the connection"));
     ui->pb_send->setEnabled(false);
@@ -151,29 +275,22 @@ void ClientWindow::disconnectedFromServer()
 void ClientWindow::userJoined(const QString &nickname)
 {
     // печать на экран информации о том, что подключен новый пользователь
-
-    const int newRow = _chatModel->rowCount();
-    _chatModel->insertRow(newRow);
-    _chatModel->setData(_chatModel->index(newRow, 0), tr("%1 is connected").arg(nickname));
-    _chatModel->setData(_chatModel->index(newRow, 0), Qt::AlignCenter, Qt::TextAlignmentRole);
-    _chatModel->setData(_chatModel->index(newRow, 0), QBrush(Qt::blue), Qt::ForegroundRole);
-    ui->messagesView->scrollToBottom();
-
-    _lastNickname.clear();
+    appendNotice(tr("%1 is connected").arg(nickname), Qt::blue);
 }
 
 void ClientWindow::userLeft(const QString &nickname)
 {
     // печать на экран информации о том, что пользователь отключился
+    appendNotice(tr("%1 disconnected").arg(nickname), Qt::red);
+}
 
-    const int newRow = _chatModel->rowCount();
-    _chatModel->insertRow(newRow);
-    _chatModel->setData(_chatModel->index(newRow, 0), tr("%1 disconnected").arg(nickname));
-    _chatModel->setData(_chatModel->index(newRow, 0), Qt::AlignCenter, Qt::TextAlignmentRole);
-    _chatModel->setData(_chatModel->index(newRow, 0), QBrush(Qt::red), Qt::ForegroundRole);
-    ui->messagesView->scrollToBottom();
-
-    _lastNickname.clear();
+void ClientWindow::rosterReceived(const QStringList &nicknames)
+{
+    // список пользователей в сети при логине; длинный список не печатаем
+    if (nicknames.size() <= 20)
+        appendNotice(tr("online: %1").arg(nicknames.join(QStringLiteral(", "))), Qt::darkGreen);
+    else
+        appendNotice(tr("%n user(s) online", nullptr, nicknames.size()), Qt::darkGreen);
 }
 
 void ClientWindow::error(QAbstractSocket::SocketError socketError)
@@ -6,7 +6,7 @@
 #include <QDebug>
 
 class Client;
-class QStandardItemModel;
+class ChatModel;
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class ClientWindow; }
@@ -28,18 +28,30 @@ private slots:
     void connectedToServer();
     void attemptLogin(const QString &userName);
     void loggedIn();
+    void sessionResumed();
     void loginFailed(const QString &reason);
     void messageReceived(const QString &sender, const QString &text);
+    void directMessageReceived(const QString &sender, const QString &text);
+    void directMessageFailed(const QString &to, const QString &reason);
+    void roomMessageReceived(const QString &room, const QString &sender, const QString &text);
+    void roomJoined(const QString &room);
+    void roomLeft(const QString &room);
+    void roomUserJoined(const QString &room, const QString &nickname);
+    void roomUserLeft(const QString &room, const QString &nickname);
+    void messagesDropped(int count);
     void sendMessage();
     void disconnectedFromServer();
     void userJoined(const QString &username);
     void userLeft(const QString &username);
+    void rosterReceived(const QStringList &nicknames);
     void error(QAbstractSocket::SocketError socketError);
 
 private:
+    void appendNotice(const QString &text, Qt::GlobalColor color);     // служебная строка по центру экрана
+
     Ui::ClientWindow *ui;
     Client *_client;
-    QStandardItemModel *_chatModel;
+    ChatModel *_chatModel;                                              // лента чата с ограниченным числом строк
     QString _lastNickname;
 };
 #endif // CLIENTWINDOW_H
@@ -0,0 +1,534 @@
+#include "client.h"
+#include "clientlistener.h"
+#include <QTcpSocket>
+#include <QDataStream>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QtEndian>
+#include <cstring>
+
+Client::Client(QObject *parent)
+    : QObject(parent)
+    , _clientSocket(new QTcpSocket(this))
+    , _loggedIn(false)
+    , _binaryProtocol(false)
+    , _sessionId(0)
+    , _rosterVersion(0)
+    , _rosterSynced(false)
+    , _receivedSeq(0)
+    , _listenerContext(nullptr)
+{
+    // коннекты между сигналами клиента и qtcpsocket
+
+    connect(_clientSocket, &QTcpSocket::connected, this, &Client::connected);
+    connect(_clientSocket, &QTcpSocket::disconnected, this, &Client::disconnected);
+    connect(_clientSocket, &QTcpSocket::readyRead, this, &Client::onReadyRead);
+    connect(_clientSocket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error), this, &Client::error);
+    connect(_clientSocket, &QTcpSocket::disconnected, this, [this]()->void{_loggedIn = false; _binaryProtocol = false; _compressor.reset(); _decompressor.reset(); _roster.clear(); _rosterSynced = false;});
+}
+
+void Client::setListener(ClientListener *listener)
+{
+    // соединения слушателя живут в отдельном объекте: при смене слушателя удаляются вместе с ним
+    delete _listenerContext;
+    _listenerContext = nullptr;
+    if (!listener)
+        return;
+
+    _listenerContext = new QObject(this);
+    connect(this, &Client::connected, _listenerContext, [listener]() { listener->onConnected(); });
+    connect(this, &Client::disconnected, _listenerContext, [listener]() { listener->onDisconnected(); });
+    connect(this, &Client::error, _listenerContext, [listener](QAbstractSocket::SocketError socketError) { listener->onError(socketError); });
+    connect(this, &Client::loggedIn, _listenerContext, [listener]() { listener->onLoggedIn(); });
+    connect(this, &Client::sessionResumed, _listenerContext, [listener]() { listener->onSessionResumed(); });
+    connect(this, &Client::loginError, _listenerContext, [listener](const QString &reason) { listener->onLoginError(reason); });
+    connect(this, &Client::messageReceived, _listenerContext, [listener](const QString &sender, const QString &text) { listener->onMessage(sender, text); });
+    connect(this, &Client::directMessageReceived, _listenerContext, [listener](const QString &sender, const QString &text) { listener->onDirectMessage(sender, text); });
+    connect(this, &Client::directMessageFailed, _listenerContext, [listener](const QString &to, const QString &reason) { listener->onDirectMessageFailed(to, reason); });
+    connect(this, &Client::userJoined, _listenerContext, [listener](const QString &nickname) { listener->onUserJoined(nickname); });
+    connect(this, &Client::userLeft, _listenerContext, [listener](const QString &nickname) { listener->onUserLeft(nickname); });
+    connect(this, &Client::rosterReceived, _listenerContext, [listener](const QStringList &nicknames) { listener->onRoster(nicknames); });
+    connect(this, &Client::roomJoined, _listenerContext, [listener](const QString &room) { listener->onRoomJoined(room); });
+    connect(this, &Client::roomLeft, _listenerContext, [listener](const QString &room) { listener->onRoomLeft(room); });
+    connect(this, &Client::roomMessageReceived, _listenerContext, [listener](const QString &room, const QString &sender, const QString &text) { listener->onRoomMessage(room, sender, text); });
+    connect(this, &Client::roomUserJoined, _listenerContext, [listener](const QString &room, const QString &nickname) { listener->onRoomUserJoined(room, nickname); });
+    connect(this, &Client::roomUserLeft, _listenerContext, [listener](const QString &room, const QString &nickname) { listener->onRoomUserLeft(room, nickname); });
+    connect(this, &Client::messagesDropped, _listenerContext, [listener](int count) { listener->onMessagesDropped(count); });
+}
+
+void Client::connectToServer(const QHostAddress &address, quint16 port)
+{
+    _clientSocket->connectToHost(address, port);
+}
+
+void Client::disconnectFromHost()
+{
+    // выход по желанию пользователя - сервер сразу закрывает сессию, а не держит ее для восстановления
+    if (_loggedIn)
+    {
+        writeFrame(QByteArrayLiteral("{\"type\":\"logout\"}"));
+        _clientSocket->flush();
+    }
+    _resumeToken.clear();
+    _clientSocket->disconnectFromHost();
+}
+
+void Client::appendFrame(QByteArray &buffer, const QByteArray &data)
+{
+    // после согласования сжатия крупные фреймы уходят сжатыми
+    QByteArray compressed;
+    if (_compressor && data.size() >= Compression::DefaultThreshold)
+        compressed = _compressor->compress(data);
+    const QByteArray &payload = compressed.isEmpty() ? data : compressed;
+
+    // префикс длины как у QDataStream << QByteArray
+    const int offset = buffer.size();
+    buffer.resize(offset + int(sizeof(quint32)) + payload.size());
+    qToBigEndian<quint32>(quint32(payload.size()), buffer.data() + offset);
+    memcpy(buffer.data() + offset + sizeof(quint32), payload.constData(), size_t(payload.size()));
+}
+
+void Client::writeFrame(const QByteArray &data)
+{
+    QByteArray frame;
+    appendFrame(frame, data);
+    _clientSocket->write(frame);
+}
+
+QByteArray Client::encodeMessage(const QString &text) const
+{
+    // после согласования бинарного протокола сообщение уходит без json
+    if (_binaryProtocol)
+        return BinaryProtocol::encode(BinaryProtocol::ChatMessage, _sessionId, text.toUtf8());
+
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("message");
+    message[QStringLiteral("text")] = text;
+    return QJsonDocument(message).toJson(QJsonDocument::Compact);
+}
+
+void Client::login(const QString &nickname)
+{
+    // если соединение установлено - записываем в сокет никнейм и тип операции - login
+    if (_clientSocket->state() == QAbstractSocket::ConnectedState)
+    {
+        QJsonObject message;
+        message[QStringLiteral("type")] = QStringLiteral("login");
+        message[QStringLiteral("nickname")] = nickname;
+        message[QStringLiteral("protocol")] = BinaryProtocol::name();  // предлагаем бинарный протокол
+        message[QStringLiteral("compression")] = Compression::name();  // и сжатие
+        message[QStringLiteral("presence")] = QStringLiteral("roster"); // список пользователей снимком и дельтами
+
+        // токен прошлой сессии с тем же ником - сервер дошлет то, что было после seq; пустой - просим новый токен
+        const bool resume = !_resumeToken.isEmpty() && nickname.compare(_nickname, Qt::CaseInsensitive) == 0;
+        message[QStringLiteral("resume")] = resume ? _resumeToken : QString();
+        if (resume)
+            message[QStringLiteral("seq")] = double(_receivedSeq);
+        _nickname = nickname;
+        writeFrame(QJsonDocument(message).toJson(QJsonDocument::Compact));
+    }
+}
+
+void Client::resumeSession()
+{
+    if (canResume())
+        login(_nickname);
+}
+
+bool Client::canResume() const
+{
+    return !_resumeToken.isEmpty();
+}
+
+void Client::sendMessage(const QString &text)
+{
+    if (text.isEmpty())
+        return;
+
+    writeFrame(encodeMessage(text));
+}
+
+void Client::sendMessages(const QStringList &texts)
+{
+    // все сообщения собираются в один буфер и уходят в сокет одной записью
+    QByteArray batch;
+    for (const QString &text : texts)
+    {
+        if (!text.isEmpty())
+            appendFrame(batch, encodeMessage(text));
+    }
+
+    if (!batch.isEmpty())
+        _clientSocket->write(batch);
+}
+
+void Client::sendDirectMessage(const QString &to, const QString &text)
+{
+    if (to.isEmpty() || text.isEmpty())
+        return;
+
+    // личное сообщение всегда в json - в нем есть адресат
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("direct");
+    message[QStringLiteral("to")] = to;
+    message[QStringLiteral("text")] = text;
+
+    writeFrame(QJsonDocument(message).toJson(QJsonDocument::Compact));
+}
+
+void Client::joinRoom(const QString &room)
+{
+    if (room.isEmpty())
+        return;
+
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("join");
+    message[QStringLiteral("room")] = room;
+
+    writeFrame(QJsonDocument(message).toJson(QJsonDocument::Compact));
+}
+
+void Client::leaveRoom(const QString &room)
+{
+    if (room.isEmpty())
+        return;
+
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("leave");
+    message[QStringLiteral("room")] = room;
+
+    writeFrame(QJsonDocument(message).toJson(QJsonDocument::Compact));
+}
+
+void Client::sendRoomMessage(const QString &room, const QString &text)
+{
+    if (room.isEmpty() || text.isEmpty())
+        return;
+
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("message");
+    message[QStringLiteral("room")] = room;
+    message[QStringLiteral("text")] = text;
+
+    writeFrame(QJsonDocument(message).toJson(QJsonDocument::Compact));
+}
+
+void Client::requestHistory(quint64 before, int count)
+{
+    if (count <= 0)
+        return;
+
+    // сообщения придут обычными "message" с номерами seq
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("history");
+    message[QStringLiteral("before")] = double(before);
+    message[QStringLiteral("count")] = count;
+
+    writeFrame(QJsonDocument(message).toJson(QJsonDocument::Compact));
+}
+
+void Client::requestRoster()
+{
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("roster");
+    writeFrame(QJsonDocument(message).toJson(QJsonDocument::Compact));
+}
+
+QStringList Client::roster() const
+{
+    QStringList nicknames = _roster.values();
+    nicknames.sort(Qt::CaseInsensitive);
+    return nicknames;
+}
+
+void Client::jsonReceived(const QJsonObject &docObj)
+{
+    const QJsonValue typeVal = docObj.value(QLatin1String("type"));
+
+    if (typeVal.isNull() || !typeVal.isString())
+        return;
+
+    // если авторизация
+    if (typeVal.toString().compare(QLatin1String("login"), Qt::CaseInsensitive) == 0)
+    {
+        // уже авторизован - выходим
+        if (_loggedIn)
+            return;
+
+        // вытягиваем результат операции
+        const QJsonValue resultVal = docObj.value(QLatin1String("success"));
+        if (resultVal.isNull() || !resultVal.isBool())
+            return;
+
+        // приводим к bool
+        const bool loginSuccess = resultVal.toBool();
+
+        // если авторизация успешна - вызов сигнала
+        if (loginSuccess)
+        {
+            _loggedIn = true;
+            _sessionId = quint32(docObj.value(QLatin1String("id")).toDouble());
+            _binaryProtocol = docObj.value(QLatin1String("protocol")).toString() == BinaryProtocol::name();
+            if (docObj.value(QLatin1String("compression")).toString() == Compression::name())
+            {
+                _compressor.reset(new FrameCompressor);
+                _decompressor.reset(new FrameDecompressor);
+            }
+
+            // нумерация фреймов сессии начинается после этого ответа
+            _resumeToken = docObj.value(QLatin1String("token")).toString();
+            _receivedSeq = 0;
+            if (docObj.value(QLatin1String("resumed")).toBool())
+                emit sessionResumed();
+            emit loggedIn();
+            return;
+        }
+
+        _resumeToken.clear();
+        const QJsonValue reasonVal = docObj.value(QLatin1String("reason"));
+        emit loginError(reasonVal.toString());
+    }
+
+    // если пришло сообщение
+    else if (typeVal.toString().compare(QLatin1String("message"), Qt::CaseInsensitive) == 0)
+    {
+        const QJsonValue textVal = docObj.value(QLatin1String("text"));
+        const QJsonValue senderVal = docObj.value(QLatin1String("sender"));
+
+
+        if (textVal.isNull() || !textVal.isString())
+            return;
+        if (senderVal.isNull() || !senderVal.isString())
+            return;
+
+        // сообщение из комнаты (у общей комнаты имени нет)
+        const QJsonValue roomVal = docObj.value(QLatin1String("room"));
+        if (roomVal.isString())
+        {
+            emit roomMessageReceived(roomVal.toString(), senderVal.toString(), textVal.toString());
+            return;
+        }
+
+        // печать сообщения, если корректные данные
+        emit messageReceived(senderVal.toString(), textVal.toString());
+    }
+
+    // результат входа в комнату или выхода из нее
+    else if (typeVal.toString().compare(QLatin1String("join"), Qt::CaseInsensitive) == 0)
+    {
+        if (docObj.value(QLatin1String("success")).toBool())
+            emit roomJoined(docObj.value(QLatin1String("room")).toString());
+    }
+    else if (typeVal.toString().compare(QLatin1String("leave"), Qt::CaseInsensitive) == 0)
+    {
+        if (docObj.value(QLatin1String("success")).toBool())
+            emit roomLeft(docObj.value(QLatin1String("room")).toString());
+    }
+
+    // пришло личное сообщение
+    else if (typeVal.toString().compare(QLatin1String("direct"), Qt::CaseInsensitive) == 0)
+    {
+        const QJsonValue textVal = docObj.value(QLatin1String("text"));
+        const QJsonValue senderVal = docObj.value(QLatin1String("sender"));
+
+        if (textVal.isNull() || !textVal.isString())
+            return;
+        if (senderVal.isNull() || !senderVal.isString())
+            return;
+
+        emit directMessageReceived(senderVal.toString(), textVal.toString());
+    }
+
+    // личное сообщение не доставлено
+    else if (typeVal.toString().compare(QLatin1String("directfailed"), Qt::CaseInsensitive) == 0)
+    {
+        emit directMessageFailed(docObj.value(QLatin1String("to")).toString(), docObj.value(QLatin1String("reason")).toString());
+    }
+
+    // проверка живости соединения - отвечаем сразу
+    else if (typeVal.toString().compare(QLatin1String("ping"), Qt::CaseInsensitive) == 0)
+    {
+        writeFrame(QByteArrayLiteral("{\"type\":\"pong\"}"));
+    }
+
+    // сервер не успевал отправлять и пропустил часть сообщений
+    else if (typeVal.toString().compare(QLatin1String("dropped"), Qt::CaseInsensitive) == 0)
+    {
+        emit messagesDropped(docObj.value(QLatin1String("count")).toInt());
+    }
+
+    // список пользователей: снимок и дельты
+    else if (typeVal.toString().compare(QLatin1String("roster"), Qt::CaseInsensitive) == 0)
+    {
+        rosterSnapshot(docObj);
+    }
+    else if (typeVal.toString().compare(QLatin1String("presence"), Qt::CaseInsensitive) == 0)
+    {
+        rosterDelta(docObj);
+    }
+
+    // подключился новый пользователь
+    else if (typeVal.toString().compare(QLatin1String("newuser"), Qt::CaseInsensitive) == 0)
+    {
+        const QJsonValue nicknameVal = docObj.value(QLatin1String("nickname"));
+        if (nicknameVal.isNull() || !nicknameVal.isString())
+            return;
+
+        const QJsonValue roomVal = docObj.value(QLatin1String("room"));
+        if (roomVal.isString())
+        {
+            emit roomUserJoined(roomVal.toString(), nicknameVal.toString());
+            return;
+        }
+
+        // печать на экран
+        emit userJoined(nicknameVal.toString());
+    }
+
+    // пользователь отключился
+    else if (typeVal.toString().compare(QLatin1String("userdisconnected"), Qt::CaseInsensitive) == 0)
+    {
+        const QJsonValue nicknameVal = docObj.value(QLatin1String("nickname"));
+        if (nicknameVal.isNull() || !nicknameVal.isString())
+            return;
+
+        const QJsonValue roomVal = docObj.value(QLatin1String("room"));
+        if (roomVal.isString())
+        {
+            emit roomUserLeft(roomVal.toString(), nicknameVal.toString());
+            return;
+        }
+
+        // печать на экран
+        emit userLeft(nicknameVal.toString());
+    }
+}
+
+void Client::rosterSnapshot(const QJsonObject &docObj)
+{
+    _roster.clear();
+    const QJsonArray users = docObj.value(QLatin1String("users")).toArray();
+    for (const QJsonValue &user : users)
+        _roster.insert(user.toString().toLower(), user.toString());
+    _rosterVersion = quint64(docObj.value(QLatin1String("version")).toDouble());
+    _rosterSynced = true;
+    emit rosterReceived(roster());
+}
+
+void Client::rosterDelta(const QJsonObject &docObj)
+{
+    if (!_rosterSynced)
+        return;
+
+    // дельта с уже учтенной версией - повтор; пропуск версии - запрашиваем снимок и ждем его
+    const quint64 seq = quint64(docObj.value(QLatin1String("seq")).toDouble());
+    if (seq <= _rosterVersion)
+        return;
+    if (seq != _rosterVersion + 1)
+    {
+        _rosterSynced = false;
+        requestRoster();
+        return;
+    }
+    _rosterVersion = seq;
+
+    const QJsonArray joined = docObj.value(QLatin1String("joined")).toArray();
+    for (const QJsonValue &user : joined)
+    {
+        const QString nickname = user.toString();
+        _roster.insert(nickname.toLower(), nickname);
+        if (nickname.compare(_nickname, Qt::CaseInsensitive) != 0)
+            emit userJoined(nickname);
+    }
+    const QJsonArray left = docObj.value(QLatin1String("left")).toArray();
+    for (const QJsonValue &user : left)
+    {
+        _roster.remove(user.toString().toLower());
+        emit userLeft(user.toString());
+    }
+}
+
+void Client::binaryReceived(const BinaryMessage &message)
+{
+    switch (message.type)
+    {
+    case BinaryProtocol::ChatMessage:
+    {
+        QString sender, text;
+        if (BinaryProtocol::decodeChat(message.payload, sender, text))
+            emit messageReceived(sender, text);
+        break;
+    }
+    case BinaryProtocol::DirectMessage:
+    {
+        QString sender, text;
+        if (BinaryProtocol::decodeChat(message.payload, sender, text))
+            emit directMessageReceived(sender, text);
+        break;
+    }
+    case BinaryProtocol::UserJoined:
+        emit userJoined(QString::fromUtf8(message.payload));
+        break;
+    case BinaryProtocol::UserLeft:
+        emit userLeft(QString::fromUtf8(message.payload));
+        break;
+    default:
+        break;
+    }
+}
+
+void Client::onReadyRead()
+{
+    QByteArray jsonData;
+    QDataStream socketStream(_clientSocket);
+
+
+    while (true)
+    {
+        // считываем инфу из сокета
+        socketStream.startTransaction();
+        socketStream >> jsonData;
+
+        // если ошибок чтения не произошло - проверяем на ошибки json
+        if (socketStream.commitTransaction())
+        {
+            // каждый фрейм после ответа на логин - следующий номер сессии, даже если он не разобран
+            if (_loggedIn)
+                ++_receivedSeq;
+
+            // сжатый фрейм сначала распаковываем
+            if (Compression::isCompressed(jsonData))
+            {
+                QByteArray inflated;
+                if (!_decompressor || !_decompressor->decompress(jsonData, inflated))
+                    continue;
+                jsonData = inflated;
+            }
+
+            // бинарное сообщение разбирается без json
+            if (BinaryProtocol::isBinary(jsonData))
+            {
+                BinaryMessage message;
+                if (BinaryProtocol::decode(jsonData, message))
+                    binaryReceived(message);
+                continue;
+            }
+
+            QJsonParseError parseError;
+            const QJsonDocument jsonDoc = QJsonDocument::fromJson(jsonData, &parseError);
+            if (parseError.error == QJsonParseError::NoError)
+            {
+                if (jsonDoc.isObject())
+                    jsonReceived(jsonDoc.object());
+            }
+        }
+
+        // ошибка чтения - выход из цикла
+        else
+        {
+            break;
+        }
+    }
+}
+
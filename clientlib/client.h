@@ -0,0 +1,88 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QScopedPointer>
+#include <QHash>
+#include <QStringList>
+#include "binaryprotocol.h"
+#include "compression.h"
+
+class ClientListener;
+
+// клиент чата без виджетов: события приходят сигналами и/или через ClientListener
+
+class Client : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(Client)
+
+public:
+    explicit Client(QObject *parent = nullptr);
+
+    void setListener(ClientListener *listener);                         // nullptr - отключить; слушатель не удаляется клиентом
+    QStringList roster() const;                                         // пользователи в сети по снимку и дельтам сервера
+    bool canResume() const;                                             // есть токен сессии: после обрыва ее можно восстановить
+
+public slots:
+    void connectToServer(const QHostAddress &address, quint16 port);    // подключение к серверу
+    void login(const QString &nickname);                                // логин - передает никнейм через сокет (json)
+    void resumeSession();                                               // повторный логин с токеном оборванной сессии
+    void sendMessage(const QString &text);                              // отправка сообщения (json или бинарное)
+    void sendMessages(const QStringList &texts);                        // пачка сообщений одной записью в сокет
+    void sendDirectMessage(const QString &to, const QString &text);     // личное сообщение пользователю to (json)
+    void joinRoom(const QString &room);                                 // вход в комнату (json)
+    void leaveRoom(const QString &room);                                // выход из комнаты (json)
+    void sendRoomMessage(const QString &room, const QString &text);     // сообщение участникам комнаты (json)
+    void requestHistory(quint64 before, int count);                     // count сообщений общей комнаты перед номером before (json)
+    void requestRoster();                                               // снимок списка пользователей заново (json)
+    void disconnectFromHost();                                          // выход и дисконнект от сервера, сессия не восстанавливается
+
+private slots:
+    void onReadyRead();
+
+signals:
+    void connected();
+    void loggedIn();
+    void sessionResumed();                                              // перед loggedIn: сервер восстановил сессию и досылает пропущенное
+    void loginError(const QString &reason);
+    void disconnected();
+    void messageReceived(const QString &sender, const QString &text);
+    void directMessageReceived(const QString &sender, const QString &text);
+    void directMessageFailed(const QString &to, const QString &reason);
+    void error(QAbstractSocket::SocketError socketError);
+    void userJoined(const QString &nickname);
+    void userLeft(const QString &nickname);
+    void rosterReceived(const QStringList &nicknames);                  // снимок списка пользователей: при логине и после пропуска дельты
+    void roomJoined(const QString &room);
+    void roomLeft(const QString &room);
+    void roomMessageReceived(const QString &room, const QString &sender, const QString &text);
+    void roomUserJoined(const QString &room, const QString &nickname);
+    void roomUserLeft(const QString &room, const QString &nickname);
+    void messagesDropped(int count);                                    // сервер пропустил сообщения, пока клиент не успевал их принимать
+private:
+    QTcpSocket* _clientSocket;
+    bool _loggedIn;
+    bool _binaryProtocol;                   // сервер согласился на бинарный протокол
+    quint32 _sessionId;                     // идентификатор сессии, выданный сервером
+    QString _nickname;                      // ник из последнего login
+    QHash<QString, QString> _roster;        // ник в нижнем регистре -> ник
+    quint64 _rosterVersion;
+    bool _rosterSynced;                     // снимок получен, дельты применяются
+    QString _resumeToken;                   // токен сессии для восстановления после обрыва
+    quint64 _receivedSeq;                   // фреймов получено после ответа на логин - с него сервер досылает пропущенное
+    QScopedPointer<FrameCompressor> _compressor;        // есть, если сервер согласился на сжатие
+    QScopedPointer<FrameDecompressor> _decompressor;
+    QObject *_listenerContext;              // владелец соединений слушателя
+    void appendFrame(QByteArray &buffer, const QByteArray &data);      // длина + данные (сжатые после согласования) в конец буфера
+    void writeFrame(const QByteArray &data);
+    QByteArray encodeMessage(const QString &text) const;
+    void jsonReceived(const QJsonObject &doc);
+    void binaryReceived(const BinaryMessage &message);
+    void rosterSnapshot(const QJsonObject &doc);
+    void rosterDelta(const QJsonObject &doc);
+
+};
+
+#endif // CLIENT_H
@@ -0,0 +1,18 @@
+QT -= gui
+QT += network
+
+TEMPLATE = lib
+CONFIG += staticlib c++11
+
+INCLUDEPATH += ../common
+
+SOURCES += \
+    ../common/binaryprotocol.cpp \
+    ../common/compression.cpp \
+    client.cpp
+
+HEADERS += \
+    ../common/binaryprotocol.h \
+    ../common/compression.h \
+    client.h \
+    clientlistener.h
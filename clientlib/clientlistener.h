@@ -0,0 +1,36 @@
+#ifndef CLIENTLISTENER_H
+#define CLIENTLISTENER_H
+
+#include <QString>
+#include <QStringList>
+#include <QAbstractSocket>
+
+// обратные вызовы клиента без сигналов и виджетов - для ботов и мостов.
+// вызываются в потоке Client; переопределяются только нужные методы
+
+class ClientListener
+{
+public:
+    virtual ~ClientListener() {}
+
+    virtual void onConnected() {}
+    virtual void onDisconnected() {}
+    virtual void onError(QAbstractSocket::SocketError socketError) { Q_UNUSED(socketError) }
+    virtual void onLoggedIn() {}
+    virtual void onSessionResumed() {}
+    virtual void onLoginError(const QString &reason) { Q_UNUSED(reason) }
+    virtual void onMessage(const QString &sender, const QString &text) { Q_UNUSED(sender) Q_UNUSED(text) }
+    virtual void onDirectMessage(const QString &sender, const QString &text) { Q_UNUSED(sender) Q_UNUSED(text) }
+    virtual void onDirectMessageFailed(const QString &to, const QString &reason) { Q_UNUSED(to) Q_UNUSED(reason) }
+    virtual void onUserJoined(const QString &nickname) { Q_UNUSED(nickname) }
+    virtual void onUserLeft(const QString &nickname) { Q_UNUSED(nickname) }
+    virtual void onRoster(const QStringList &nicknames) { Q_UNUSED(nicknames) }
+    virtual void onRoomJoined(const QString &room) { Q_UNUSED(room) }
+    virtual void onRoomLeft(const QString &room) { Q_UNUSED(room) }
+    virtual void onRoomMessage(const QString &room, const QString &sender, const QString &text) { Q_UNUSED(room) Q_UNUSED(sender) Q_UNUSED(text) }
+    virtual void onRoomUserJoined(const QString &room, const QString &nickname) { Q_UNUSED(room) Q_UNUSED(nickname) }
+    virtual void onRoomUserLeft(const QString &room, const QString &nickname) { Q_UNUSED(room) Q_UNUSED(nickname) }
+    virtual void onMessagesDropped(int count) { Q_UNUSED(count) }
+};
+
+#endif // CLIENTLISTENER_H
@@ -0,0 +1,76 @@
+#include "binaryprotocol.h"
+#include <QtEndian>
+#include <cstring>
+
+QString BinaryProtocol::name()
+{
+    return QStringLiteral("binary");
+}
+
+bool BinaryProtocol::isBinary(const QByteArray &data)
+{
+    return !data.isEmpty() && quint8(data.at(0)) == Magic;
+}
+
+QByteArray BinaryProtocol::encode(quint8 type, quint32 senderId, const QByteArray &payload)
+{
+    // заголовок + данные одним буфером
+    QByteArray data(HeaderSize + payload.size(), Qt::Uninitialized);
+    uchar *header = reinterpret_cast<uchar *>(data.data());
+    header[0] = Magic;
+    header[1] = type;
+    qToBigEndian<quint16>(0, header + 2);
+    qToBigEndian<quint32>(senderId, header + 4);
+    qToBigEndian<quint32>(quint32(payload.size()), header + 8);
+    memcpy(header + HeaderSize, payload.constData(), size_t(payload.size()));
+    return data;
+}
+
+bool BinaryProtocol::decode(const QByteArray &data, BinaryMessage &message)
+{
+    return decode(data.constData(), data.size(), message);
+}
+
+bool BinaryProtocol::decode(const char *data, int size, BinaryMessage &message)
+{
+    if (size < HeaderSize || quint8(data[0]) != Magic)
+        return false;
+
+    // длина в заголовке должна совпадать с размером фрейма
+    const uchar *header = reinterpret_cast<const uchar *>(data);
+    const quint32 length = qFromBigEndian<quint32>(header + 8);
+    if (length != quint32(size - HeaderSize))
+        return false;
+
+    message.type = header[1];
+    message.senderId = qFromBigEndian<quint32>(header + 4);
+    message.payload = QByteArray(data + HeaderSize, size - HeaderSize);
+    return true;
+}
+
+QByteArray BinaryProtocol::encodeChat(const QString &sender, const QString &text)
+{
+    // quint16 длина ника + ник + текст до конца данных
+    const QByteArray senderData = sender.toUtf8().left(0xFFFF);
+    const QByteArray textData = text.toUtf8();
+    QByteArray payload(int(sizeof(quint16)) + senderData.size() + textData.size(), Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar *>(payload.data());
+    qToBigEndian<quint16>(quint16(senderData.size()), out);
+    memcpy(out + sizeof(quint16), senderData.constData(), size_t(senderData.size()));
+    memcpy(out + sizeof(quint16) + senderData.size(), textData.constData(), size_t(textData.size()));
+    return payload;
+}
+
+bool BinaryProtocol::decodeChat(const QByteArray &payload, QString &sender, QString &text)
+{
+    if (payload.size() < int(sizeof(quint16)))
+        return false;
+
+    const int senderSize = qFromBigEndian<quint16>(reinterpret_cast<const uchar *>(payload.constData()));
+    if (payload.size() < int(sizeof(quint16)) + senderSize)
+        return false;
+
+    sender = QString::fromUtf8(payload.constData() + sizeof(quint16), senderSize);
+    text = QString::fromUtf8(payload.constData() + sizeof(quint16) + senderSize, payload.size() - int(sizeof(quint16)) - senderSize);
+    return true;
+}
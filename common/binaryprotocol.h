@@ -0,0 +1,49 @@
+#ifndef BINARYPROTOCOL_H
+#define BINARYPROTOCOL_H
+
+#include <QByteArray>
+#include <QMetaType>
+#include <QString>
+
+// компактный бинарный формат сообщений, используется вместо json после согласования при логине.
+// фрейм на проводе тот же (QDataStream: длина + данные), внутри - фиксированный заголовок и данные:
+//   quint8  magic     - BinaryProtocol::Magic, json всегда начинается с '{'
+//   quint8  type      - BinaryProtocol::Type
+//   quint16 reserved
+//   quint32 senderId  - идентификатор сессии отправителя
+//   quint32 length    - длина данных после заголовка
+// все числа в big-endian
+
+struct BinaryMessage
+{
+    quint8 type = 0;
+    quint32 senderId = 0;
+    QByteArray payload;
+};
+Q_DECLARE_METATYPE(BinaryMessage)
+
+namespace BinaryProtocol
+{
+    const quint8 Magic = 0xB1;
+    const int HeaderSize = 12;
+
+    enum Type : quint8
+    {
+        ChatMessage = 1,        // сервер -> клиент: ник отправителя + текст, клиент -> сервер: текст
+        UserJoined = 2,         // ник подключившегося пользователя
+        UserLeft = 3,           // ник отключившегося пользователя
+        DirectMessage = 4       // личное сообщение, данные как у ChatMessage от сервера
+    };
+
+    QString name();                                                         // название протокола при согласовании
+
+    bool isBinary(const QByteArray &data);
+    QByteArray encode(quint8 type, quint32 senderId, const QByteArray &payload);
+    bool decode(const QByteArray &data, BinaryMessage &message);
+    bool decode(const char *data, int size, BinaryMessage &message);
+
+    QByteArray encodeChat(const QString &sender, const QString &text);      // данные ChatMessage от сервера
+    bool decodeChat(const QByteArray &payload, QString &sender, QString &text);
+}
+
+#endif // BINARYPROTOCOL_H
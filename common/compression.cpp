@@ -0,0 +1,146 @@
+#include "compression.h"
+#include <cstring>
+
+namespace
+{
+    // начальный словарь: самые частые строки протокола ближе к концу
+    const char Dictionary[] =
+        "{\"type\":\"login\",\"success\":true,\"success\":false,\"reason\":\"\",\"protocol\":\"json\",\"compression\":\"deflate\""
+        "{\"type\":\"history\",\"before\":\"count\":{\"type\":\"dropped\",\"count\":"
+        "{\"type\":\"join\",\"room\":\"\",\"success\":true}{\"type\":\"leave\",\"room\":\"\",\"success\":true}"
+        "{\"type\":\"directfailed\",\"to\":\"\",\"reason\":\"unknown user\"}"
+        "{\"type\":\"direct\",\"to\":\"\",\"text\":\"\",\"sender\":\"\",\"senderid\":"
+        "{\"type\":\"newuser\",\"nickname\":\"\",\"senderid\":{\"type\":\"userdisconnected\",\"nickname\":\"\",\"senderid\":"
+        "{\"type\":\"message\",\"room\":\"\",\"text\":\"\",\"sender\":\"\",\"senderid\":,\"seq\":,\"time\":"
+        "{\"type\":\"message\",\"text\":\"";
+
+    const char SyncTail[] = { '\x00', '\x00', '\xff', '\xff' };
+    const int ChunkSize = 16 * 1024;
+}
+
+QString Compression::name()
+{
+    return QStringLiteral("deflate");
+}
+
+bool Compression::isCompressed(const QByteArray &data)
+{
+    return !data.isEmpty() && quint8(data.at(0)) == Marker;
+}
+
+FrameCompressor::FrameCompressor()
+    : _ready(false)
+{
+    // raw deflate (без заголовка zlib) с начальным словарем
+    memset(&_stream, 0, sizeof(_stream));
+    if (deflateInit2(&_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return;
+    _ready = deflateSetDictionary(&_stream, reinterpret_cast<const Bytef *>(Dictionary), uInt(sizeof(Dictionary) - 1)) == Z_OK;
+}
+
+FrameCompressor::~FrameCompressor()
+{
+    deflateEnd(&_stream);
+}
+
+QByteArray FrameCompressor::compress(const QByteArray &data)
+{
+    if (!_ready)
+        return QByteArray();
+
+    QByteArray result(1 + int(deflateBound(&_stream, uLong(data.size()))) + 8, Qt::Uninitialized);
+    result[0] = char(Compression::Marker);
+    int used = 1;
+
+    _stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+    _stream.avail_in = uInt(data.size());
+    do
+    {
+        if (result.size() - used < ChunkSize / 4)
+            result.resize(result.size() + ChunkSize);
+
+        _stream.next_out = reinterpret_cast<Bytef *>(result.data() + used);
+        _stream.avail_out = uInt(result.size() - used);
+        const uInt available = _stream.avail_out;
+        if (deflate(&_stream, Z_SYNC_FLUSH) == Z_STREAM_ERROR)
+        {
+            _ready = false;
+            return QByteArray();
+        }
+        used += int(available - _stream.avail_out);
+    } while (_stream.avail_out == 0);
+
+    // Z_SYNC_FLUSH всегда заканчивается 00 00 ff ff - не передаем его, получатель добавит сам
+    if (used >= 5 && memcmp(result.constData() + used - 4, SyncTail, 4) == 0)
+        used -= 4;
+    result.resize(used);
+    return result;
+}
+
+FrameDecompressor::FrameDecompressor()
+    : _ready(false)
+{
+    memset(&_stream, 0, sizeof(_stream));
+    if (inflateInit2(&_stream, -MAX_WBITS) != Z_OK)
+        return;
+    _ready = inflateSetDictionary(&_stream, reinterpret_cast<const Bytef *>(Dictionary), uInt(sizeof(Dictionary) - 1)) == Z_OK;
+}
+
+FrameDecompressor::~FrameDecompressor()
+{
+    inflateEnd(&_stream);
+}
+
+bool FrameDecompressor::decompress(const QByteArray &data, QByteArray &result, int maxSize)
+{
+    if (!_ready || !Compression::isCompressed(data))
+        return false;
+
+    // возвращаем отрезанный отправителем хвост синхронизации
+    QByteArray input = data.mid(1);
+    input.append(SyncTail, 4);
+
+    result.resize(ChunkSize);
+    int used = 0;
+    _stream.next_in = reinterpret_cast<Bytef *>(input.data());
+    _stream.avail_in = uInt(input.size());
+    for (;;)
+    {
+        if (result.size() - used < ChunkSize / 4)
+        {
+            // защита от "zip-бомб"
+            if (result.size() + ChunkSize > qMax(maxSize, ChunkSize))
+            {
+                _ready = false;
+                return false;
+            }
+            result.resize(result.size() + ChunkSize);
+        }
+
+        _stream.next_out = reinterpret_cast<Bytef *>(result.data() + used);
+        _stream.avail_out = uInt(result.size() - used);
+        const uInt available = _stream.avail_out;
+        const int status = inflate(&_stream, Z_SYNC_FLUSH);
+        if (status != Z_OK && status != Z_BUF_ERROR)
+        {
+            _ready = false;
+            return false;
+        }
+
+        const uInt produced = available - _stream.avail_out;
+        used += int(produced);
+
+        // вход разобран и весь вывод забран
+        if (_stream.avail_in == 0 && _stream.avail_out != 0)
+            break;
+        if (status == Z_BUF_ERROR && produced == 0)
+            break;
+    }
+    if (used > maxSize)
+    {
+        _ready = false;
+        return false;
+    }
+    result.resize(used);
+    return true;
+}
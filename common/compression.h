@@ -0,0 +1,54 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <QByteArray>
+#include <QString>
+#include <zlib.h>
+
+// сжатие фреймов, согласуется при логине ("compression":"deflate").
+// поток deflate живет все время соединения (общий словарь между сообщениями),
+// начальный словарь - ключи и типы сообщений протокола.
+// сжатый фрейм: байт Compression::Marker + данные deflate без хвоста 00 00 ff ff.
+// сжимаются только фреймы больше порога, остальные идут как есть и не трогают состояние потока
+
+namespace Compression
+{
+    const quint8 Marker = 0xC7;                 // json начинается с '{', бинарный фрейм - с BinaryProtocol::Magic
+    const int DefaultThreshold = 128;           // фреймы меньше этого размера не сжимаются
+    const int MaxInflatedSize = 16 * 1024 * 1024;
+
+    QString name();
+    bool isCompressed(const QByteArray &data);
+}
+
+class FrameCompressor
+{
+    Q_DISABLE_COPY(FrameCompressor)
+
+public:
+    FrameCompressor();
+    ~FrameCompressor();
+
+    QByteArray compress(const QByteArray &data);    // маркер + сжатые данные, пустой массив при ошибке
+
+private:
+    z_stream _stream;
+    bool _ready;
+};
+
+class FrameDecompressor
+{
+    Q_DISABLE_COPY(FrameDecompressor)
+
+public:
+    FrameDecompressor();
+    ~FrameDecompressor();
+
+    bool decompress(const QByteArray &data, QByteArray &result, int maxSize = Compression::MaxInflatedSize);   // data - с маркером
+
+private:
+    z_stream _stream;
+    bool _ready;
+};
+
+#endif // COMPRESSION_H
@@ -0,0 +1,28 @@
+QT -= gui
+QT += network
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../clientlib ../common
+DEPENDPATH += ../clientlib ../common
+
+SOURCES += \
+        loadgenerator.cpp \
+        main.cpp
+
+HEADERS += \
+    loadgenerator.h
+
+# клиентская библиотека (../clientlib), собирается отдельным подпроектом
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../clientlib/release/ -lclientlib
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../clientlib/debug/ -lclientlib
+else:unix: LIBS += -L$$OUT_PWD/../clientlib/ -lclientlib
+
+win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../clientlib/release/libclientlib.a
+else:win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../clientlib/debug/libclientlib.a
+else:win32:!win32-g++:CONFIG(release, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../clientlib/release/clientlib.lib
+else:win32:!win32-g++:CONFIG(debug, debug|release): PRE_TARGETDEPS += $$OUT_PWD/../clientlib/debug/clientlib.lib
+else:unix: PRE_TARGETDEPS += $$OUT_PWD/../clientlib/libclientlib.a
+
+LIBS += -lz
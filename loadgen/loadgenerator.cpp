@@ -0,0 +1,242 @@
+#include "loadgenerator.h"
+#include "client.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include <algorithm>
+
+LoadGenerator::LoadGenerator(const LoadSettings &settings, QObject *parent)
+    : QObject(parent)
+    , _settings(settings)
+    , _runId(QString::number(QRandomGenerator::global()->generate(), 16))
+    , _connected(0)
+    , _loggedIn(0)
+    , _errors(0)
+    , _loginDoneNs(0)
+    , _storm(0)
+    , _stormStartNs(0)
+    , _sendStartNs(0)
+    , _sendEndNs(0)
+    , _sendBudget(0)
+    , _nextSender(0)
+    , _sent(0)
+    , _received(0)
+    , _peakRss(0)
+    , _sending(false)
+{
+    connect(&_connectTimer, &QTimer::timeout, this, &LoadGenerator::connectNextBatch);
+    connect(&_sendTimer, &QTimer::timeout, this, &LoadGenerator::sendTick);
+    connect(&_sampleTimer, &QTimer::timeout, this, &LoadGenerator::sampleServer);
+    _sendTimer.setTimerType(Qt::PreciseTimer);
+}
+
+void LoadGenerator::start()
+{
+    _clock.start();
+    _clients.reserve(_settings.clients);
+    _sampleTimer.start(1000);
+    _connectTimer.start(10);
+    connectNextBatch();
+
+    // если не все клиенты залогинились за 60 секунд - начинаем с теми, что есть
+    QTimer::singleShot(60000, this, [this]() { if (!_sending) startSending(); });
+}
+
+void LoadGenerator::connectNextBatch()
+{
+    // соединения открываются порциями, чтобы не упереться в очередь accept сервера
+    for (int i = 0; i < _settings.connectBatch && _clients.size() < _settings.clients; ++i)
+        _clients.append(createClient(_clients.size()));
+
+    if (_clients.size() >= _settings.clients)
+        _connectTimer.stop();
+}
+
+Client *LoadGenerator::createClient(int index)
+{
+    // ник включает номер шторма: старое соединение с тем же ником сервер может еще не успеть закрыть
+    Client *client = new Client(this);
+    const QString nickname = QStringLiteral("lg%1_%2_%3").arg(_runId).arg(_storm).arg(index);
+
+    connect(client, &Client::connected, this, [this, client, nickname]() { ++_connected; client->login(nickname); });
+    connect(client, &Client::loggedIn, this, &LoadGenerator::clientLoggedIn);
+    connect(client, &Client::messageReceived, this, [this](const QString &, const QString &text) { messageReceived(text); });
+    connect(client, &Client::error, this, [this]() { ++_errors; });
+
+    client->connectToServer(_settings.address, _settings.port);
+    return client;
+}
+
+void LoadGenerator::clientLoggedIn()
+{
+    ++_loggedIn;
+    if (_loggedIn != _settings.clients)
+        return;
+
+    if (_storm == 0)
+        _loginDoneNs = _clock.nsecsElapsed();
+    else
+    {
+        _stormNs.append(_clock.nsecsElapsed() - _stormStartNs);
+        QTextStream(stdout) << "reconnect storm " << _storm << ": " << double(_stormNs.constLast()) / 1e9 << " s\n";
+    }
+
+    if (_storm < _settings.reconnectStorms)
+        reconnectStorm();
+    else
+        startSending();
+}
+
+void LoadGenerator::reconnectStorm()
+{
+    ++_storm;
+
+    // все соединения рвутся и открываются заново сразу, без порций connectBatch
+    for (Client *client : qAsConst(_clients))
+    {
+        client->disconnectFromHost();
+        client->deleteLater();
+    }
+    _clients.clear();
+    _connected = 0;
+    _loggedIn = 0;
+
+    _stormStartNs = _clock.nsecsElapsed();
+    for (int i = 0; i < _settings.clients; ++i)
+        _clients.append(createClient(i));
+}
+
+void LoadGenerator::startSending()
+{
+    if (_sending)
+        return;
+
+    _sending = true;
+    if (_loginDoneNs == 0)
+        _loginDoneNs = _clock.nsecsElapsed();
+
+    QTextStream(stdout) << _loggedIn << " of " << _settings.clients << " clients logged in after "
+                        << double(_loginDoneNs) / 1e9 << " s\n";
+
+    _sendStartNs = _clock.nsecsElapsed();
+    _sendTimer.start(10);
+    QTimer::singleShot(_settings.duration * 1000, this, [this]()
+    {
+        _sendTimer.stop();
+        _sendEndNs = _clock.nsecsElapsed();
+
+        // ждем доставки последних сообщений
+        QTimer::singleShot(2000, this, &LoadGenerator::finish);
+    });
+}
+
+void LoadGenerator::sendTick()
+{
+    // за каждый тик отправляем столько сообщений, сколько набежало по заданной частоте
+    static const qint64 tickNs = 10 * 1000 * 1000;
+    _sendBudget += _settings.rate * double(tickNs) / 1e9;
+
+    while (_sendBudget >= 1.0 && !_clients.isEmpty())
+    {
+        _sendBudget -= 1.0;
+        Client *client = _clients.at(_nextSender);
+        _nextSender = (_nextSender + 1) % _clients.size();
+
+        client->sendMessage(QStringLiteral("lg %1 %2").arg(_runId).arg(_clock.nsecsElapsed()));
+        ++_sent;
+    }
+}
+
+void LoadGenerator::messageReceived(const QString &text)
+{
+    // "lg <run> <время отправки>" - остальное (например, история прошлых запусков) пропускаем
+    const QStringList parts = text.split(QLatin1Char(' '));
+    if (parts.size() != 3 || parts.at(0) != QLatin1String("lg") || parts.at(1) != _runId)
+        return;
+
+    ++_received;
+    _latencies.append(_clock.nsecsElapsed() - parts.at(2).toLongLong());
+}
+
+void LoadGenerator::sampleServer()
+{
+    _peakRss = qMax(_peakRss, serverRss());
+}
+
+qint64 LoadGenerator::serverRss() const
+{
+    if (_settings.serverPid <= 0)
+        return 0;
+
+    // VmRSS из /proc/<pid>/status, значение в килобайтах
+    QFile status(QStringLiteral("/proc/%1/status").arg(_settings.serverPid));
+    if (!status.open(QIODevice::ReadOnly | QIODevice::Text))
+        return 0;
+
+    while (!status.atEnd())
+    {
+        const QByteArray line = status.readLine();
+        if (line.startsWith("VmRSS:"))
+            return line.mid(6).trimmed().split(' ').value(0).toLongLong() * 1024;
+    }
+    return 0;
+}
+
+double LoadGenerator::percentile(double p) const
+{
+    if (_latencies.isEmpty())
+        return 0;
+
+    const int index = qMin(_latencies.size() - 1, int(p * double(_latencies.size())));
+    return double(_latencies.at(index)) / 1000.0;
+}
+
+void LoadGenerator::finish()
+{
+    sampleServer();
+    std::sort(_latencies.begin(), _latencies.end());
+
+    const double sendSeconds = double(_sendEndNs - _sendStartNs) / 1e9;
+    QJsonObject results;
+    results[QStringLiteral("clients")] = _settings.clients;
+    results[QStringLiteral("connected")] = _connected;
+    results[QStringLiteral("loggedIn")] = _loggedIn;
+    results[QStringLiteral("errors")] = _errors;
+    results[QStringLiteral("loginSeconds")] = double(_loginDoneNs) / 1e9;
+    QJsonArray storms;
+    for (qint64 ns : qAsConst(_stormNs))
+        storms.append(double(ns) / 1e9);
+    results[QStringLiteral("reconnectStormSeconds")] = storms;
+    results[QStringLiteral("rate")] = _settings.rate;
+    results[QStringLiteral("sent")] = double(_sent);
+    results[QStringLiteral("delivered")] = double(_received);
+    results[QStringLiteral("sentPerSecond")] = sendSeconds > 0 ? double(_sent) / sendSeconds : 0;
+    results[QStringLiteral("deliveredPerSecond")] = sendSeconds > 0 ? double(_received) / sendSeconds : 0;
+    results[QStringLiteral("latencyP50Us")] = percentile(0.5);
+    results[QStringLiteral("latencyP99Us")] = percentile(0.99);
+    results[QStringLiteral("latencyP999Us")] = percentile(0.999);
+    results[QStringLiteral("latencyMaxUs")] = _latencies.isEmpty() ? 0 : double(_latencies.constLast()) / 1000.0;
+    results[QStringLiteral("serverRssBytes")] = double(serverRss());
+    results[QStringLiteral("serverPeakRssBytes")] = double(_peakRss);
+
+    const QByteArray json = QJsonDocument(results).toJson();
+    QTextStream(stdout) << json;
+
+    if (!_settings.output.isEmpty())
+    {
+        QFile file(_settings.output);
+        if (file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            file.write(json);
+        else
+            QTextStream(stderr) << "cannot write " << _settings.output << '\n';
+    }
+
+    for (Client *client : qAsConst(_clients))
+        client->disconnectFromHost();
+
+    emit finished(_loggedIn > 0 ? 0 : 1);
+}
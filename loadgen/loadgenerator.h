@@ -0,0 +1,87 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QTimer>
+#include <QVector>
+
+class Client;
+
+// параметры нагрузки, заполняются из командной строки в main.cpp
+struct LoadSettings
+{
+    QHostAddress address = QHostAddress::LocalHost;
+    quint16 port = 45000;
+    int clients = 1000;                 // количество соединений
+    int connectBatch = 100;             // сколько соединений открывать за один шаг (раз в 10 мс)
+    double rate = 100.0;                // сообщений в секунду от всех клиентов вместе
+    int duration = 30;                  // длительность отправки, секунд
+    int reconnectStorms = 0;            // сколько раз переподключить всех клиентов разом перед отправкой
+    qint64 serverPid = 0;               // pid сервера для замера RSS (linux, /proc)
+    QString output;                     // файл с результатами в json
+};
+
+// генератор нагрузки: открывает много соединений через класс Client, логинит их,
+// отправляет сообщения с заданной частотой и измеряет задержку доставки.
+// в текст сообщения записывается время отправки, задержка считается при получении другим клиентом.
+// шторм переподключений имитирует отказ узла: все клиенты рвут соединения и подключаются заново одновременно,
+// измеряется время до логина последнего из них
+
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(LoadGenerator)
+
+public:
+    explicit LoadGenerator(const LoadSettings &settings, QObject *parent = nullptr);
+
+public slots:
+    void start();
+
+signals:
+    void finished(int exitCode);
+
+private slots:
+    void connectNextBatch();
+    void sendTick();
+    void sampleServer();
+    void finish();
+
+private:
+    Client *createClient(int index);
+    void clientLoggedIn();
+    void reconnectStorm();
+    void messageReceived(const QString &text);
+    void startSending();
+    qint64 serverRss() const;               // RSS сервера в байтах, 0 - неизвестно
+    double percentile(double p) const;      // перцентиль задержки в микросекундах
+
+    LoadSettings _settings;
+    QVector<Client *> _clients;
+    QString _runId;                         // отличает сообщения этого запуска от истории прошлых
+    QElapsedTimer _clock;
+    QTimer _connectTimer;
+    QTimer _sendTimer;
+    QTimer _sampleTimer;
+
+    int _connected;
+    int _loggedIn;
+    int _errors;
+    qint64 _loginDoneNs;
+    int _storm;                             // номер текущего шторма переподключений, 0 - первое подключение
+    qint64 _stormStartNs;
+    QVector<qint64> _stormNs;               // время до логина всех клиентов в каждом шторме, нс
+    qint64 _sendStartNs;
+    qint64 _sendEndNs;
+    double _sendBudget;                     // накопленное количество сообщений к отправке
+    int _nextSender;
+    qint64 _sent;
+    qint64 _received;
+    qint64 _peakRss;
+    QVector<qint64> _latencies;             // задержки доставки, нс
+    bool _sending;
+};
+
+#endif // LOADGENERATOR_H
@@ -0,0 +1,40 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+#include "loadgenerator.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    // разбор параметров командной строки
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Chat server load generator. Raise the open files limit (ulimit -n) for thousands of clients."));
+    parser.addHelpOption();
+    const QCommandLineOption hostOption(QStringLiteral("host"), QStringLiteral("Server address."), QStringLiteral("address"), QStringLiteral("127.0.0.1"));
+    const QCommandLineOption portOption(QStringLiteral("port"), QStringLiteral("Server port."), QStringLiteral("port"), QStringLiteral("45000"));
+    const QCommandLineOption clientsOption(QStringLiteral("clients"), QStringLiteral("Number of connections."), QStringLiteral("count"), QStringLiteral("1000"));
+    const QCommandLineOption rateOption(QStringLiteral("rate"), QStringLiteral("Messages per second from all clients."), QStringLiteral("rate"), QStringLiteral("100"));
+    const QCommandLineOption durationOption(QStringLiteral("duration"), QStringLiteral("Sending duration in seconds."), QStringLiteral("seconds"), QStringLiteral("30"));
+    const QCommandLineOption stormsOption(QStringLiteral("reconnect-storms"), QStringLiteral("Reconnect all clients at once this many times and measure time to all logged in."), QStringLiteral("count"), QStringLiteral("0"));
+    const QCommandLineOption pidOption(QStringLiteral("server-pid"), QStringLiteral("Server process id for RSS sampling."), QStringLiteral("pid"));
+    const QCommandLineOption outputOption(QStringLiteral("output"), QStringLiteral("Write results as JSON to this file."), QStringLiteral("file"));
+    parser.addOptions({hostOption, portOption, clientsOption, rateOption, durationOption, stormsOption, pidOption, outputOption});
+    parser.process(a);
+
+    LoadSettings settings;
+    settings.address = QHostAddress(parser.value(hostOption));
+    settings.port = quint16(parser.value(portOption).toUInt());
+    settings.clients = qMax(2, parser.value(clientsOption).toInt());
+    settings.rate = qMax(0.0, parser.value(rateOption).toDouble());
+    settings.duration = qMax(1, parser.value(durationOption).toInt());
+    settings.reconnectStorms = qMax(0, parser.value(stormsOption).toInt());
+    settings.serverPid = parser.value(pidOption).toLongLong();
+    settings.output = parser.value(outputOption);
+
+    LoadGenerator generator(settings);
+    QObject::connect(&generator, &LoadGenerator::finished, &a, &QCoreApplication::exit);
+    QTimer::singleShot(0, &generator, &LoadGenerator::start);
+
+    return a.exec();
+}
@@ -0,0 +1,392 @@
+#include "clusternode.h"
+#include "framereader.h"
+#include "framewriter.h"
+#include "logger.h"
+#include "serverworker.h"
+#include "sessionregistry.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QTcpSocket>
+#include <QTimer>
+
+// пауза перед повторным подключением к узлу
+static const int ReconnectIntervalMs = 1000;
+
+// сколько ждать переподключения узла, прежде чем считать его пользователей отключившимися:
+// короткий обрыв связи между узлами не должен выглядеть для клиентов как массовый выход
+static const int NodeLossGraceMs = 5000;
+
+ClusterNode::ClusterNode(const QHostAddress &address, quint16 port, const QStringList &peers, QObject *parent)
+    : QObject(parent)
+    , _address(address)
+    , _port(port)
+    , _nodeId(0)
+{
+    // идентификатор узла случайный: после перезапуска процесс - новый узел со своим снимком пользователей
+    while (_nodeId == 0)
+        _nodeId = QRandomGenerator::global()->generate64();
+
+    for (const QString &peer : peers)
+    {
+        const int colon = peer.lastIndexOf(QLatin1Char(':'));
+        const quint16 peerPort = quint16(peer.mid(colon + 1).toUInt());
+        if (colon <= 0 || peerPort == 0)
+        {
+            LOG_WARNING(QLatin1String("invalid cluster peer: ") + peer);
+            continue;
+        }
+        _peers.append({ peer.left(colon), peerPort, nullptr, nullptr, 0 });
+    }
+
+    connect(&_server, &QTcpServer::newConnection, this, &ClusterNode::acceptPeers);
+}
+
+ClusterNode::~ClusterNode()
+{
+    for (const Inbound &inbound : qAsConst(_inbound))
+        delete inbound.reader;
+    for (const Peer &peer : qAsConst(_peers))
+        delete peer.reader;
+}
+
+bool ClusterNode::start()
+{
+    if (_port != 0 && !_server.listen(_address, _port))
+    {
+        LOG_ERROR(QStringLiteral("Cluster port %1 does'nt opened: ").arg(_port) + _server.errorString());
+        return false;
+    }
+    LOG_INFO(QStringLiteral("Cluster node %1, %2 peer(s)").arg(_nodeId, 16, 16, QLatin1Char('0')).arg(_peers.size()));
+
+    for (Peer &peer : _peers)
+        connectPeer(peer);
+    return true;
+}
+
+quint64 ClusterNode::nodeId() const
+{
+    return _nodeId;
+}
+
+void ClusterNode::connectPeer(Peer &peer)
+{
+    if (!peer.socket)
+    {
+        // адрес элемента _peers не меняется после конструктора - его можно держать в лямбдах
+        Peer *target = &peer;
+        peer.socket = new QTcpSocket(this);
+        peer.reader = new FrameReader(0);
+        peer.socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        connect(peer.socket, &QTcpSocket::connected, this, [this, target]()
+        {
+            // представляемся и отправляем всех своих пользователей, дальше - только изменения;
+            // узел отвечает своим hello - по нему личные сообщения идут только узлу адресата
+            target->socket->write(helloFrame());
+            target->socket->write(snapshotFrame());
+            LOG_INFO(QStringLiteral("Cluster peer %1:%2 connected").arg(target->host).arg(target->port));
+        });
+        connect(peer.socket, &QTcpSocket::readyRead, this, [this, target]() { readPeer(*target); });
+        connect(peer.socket, &QTcpSocket::disconnected, this, [this, target]()
+        {
+            // после переподключения по адресу может отвечать уже другой процесс
+            target->node = 0;
+            QTimer::singleShot(ReconnectIntervalMs, this, [this, target]() { connectPeer(*target); });
+        });
+        connect(peer.socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error), this, [this, target](QAbstractSocket::SocketError)
+        {
+            // отказ в подключении не проходит через disconnected - переподключаемся отсюда
+            if (target->socket->state() == QAbstractSocket::UnconnectedState)
+                QTimer::singleShot(ReconnectIntervalMs, this, [this, target]() { connectPeer(*target); });
+        });
+    }
+
+    if (peer.socket->state() == QAbstractSocket::UnconnectedState)
+        peer.socket->connectToHost(peer.host, peer.port);
+}
+
+void ClusterNode::readPeer(Peer &peer)
+{
+    peer.reader->readFrom(peer.socket);
+
+    // по исходящему соединению узел присылает только ответ на hello
+    const char *data = nullptr;
+    int size = 0;
+    while (peer.reader->nextFrame(data, size))
+    {
+        const QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromRawData(data, size));
+        if (doc.object().value(QLatin1String("type")).toString() == QLatin1String("hello"))
+            peer.node = doc.object().value(QLatin1String("node")).toString().toULongLong();
+    }
+    peer.reader->squeeze();
+}
+
+void ClusterNode::sendToPeers(const QByteArray &frame)
+{
+    // один и тот же разделяемый буфер каждому узлу
+    for (const Peer &peer : qAsConst(_peers))
+    {
+        if (peer.socket && peer.socket->state() == QAbstractSocket::ConnectedState)
+            peer.socket->write(frame);
+    }
+}
+
+void ClusterNode::announceSession(const QString &nickname)
+{
+    _localSessions.insert(SessionRegistry::nicknameKey(nickname), nickname);
+    sendToPeers(sessionFrame("add", nickname));
+}
+
+void ClusterNode::withdrawSession(const QString &nickname)
+{
+    if (_localSessions.remove(SessionRegistry::nicknameKey(nickname)) == 0)
+        return;
+    sendToPeers(sessionFrame("remove", nickname));
+}
+
+bool ClusterNode::isNicknameTaken(const QString &nickname) const
+{
+    return _remoteNicknames.contains(SessionRegistry::nicknameKey(nickname));
+}
+
+void ClusterNode::relayToRoom(const QString &room, const QByteArray &jsonFrame)
+{
+    if (_peers.isEmpty() || jsonFrame.size() <= int(sizeof(quint32)))
+        return;
+
+    // сообщение вкладывается в конверт как есть, без повторной сериализации
+    FrameWriter relay;
+    relay.add(QLatin1String("type"), QLatin1String("relay"))
+         .add(QLatin1String("room"), room)
+         .addJson(QLatin1String("message"), jsonFrame.constData() + sizeof(quint32), jsonFrame.size() - int(sizeof(quint32)));
+    sendToPeers(relay.frame());
+}
+
+bool ClusterNode::relayDirect(const QString &nickname, const QByteArray &jsonFrame)
+{
+    if (!isNicknameTaken(nickname) || jsonFrame.size() <= int(sizeof(quint32)))
+        return false;
+
+    FrameWriter relay;
+    relay.add(QLatin1String("type"), QLatin1String("relay"))
+         .add(QLatin1String("to"), nickname)
+         .addJson(QLatin1String("message"), jsonFrame.constData() + sizeof(quint32), jsonFrame.size() - int(sizeof(quint32)));
+    const QByteArray frame = relay.frame();
+
+    // сообщение получает только узел адресата; пока он не ответил на hello (или не умеет отвечать),
+    // его соединение не опознано - тогда сообщение уходит неопознанным узлам, адресата найдет владелец
+    const quint64 node = _remoteNicknames.value(SessionRegistry::nicknameKey(nickname));
+    for (const Peer &peer : qAsConst(_peers))
+    {
+        if (peer.node == node && peer.socket && peer.socket->state() == QAbstractSocket::ConnectedState)
+        {
+            peer.socket->write(frame);
+            return true;
+        }
+    }
+    // связь с узлом адресата оборвана (его пользователи еще ждут окончания NodeLossGraceMs) и неопознанных
+    // узлов нет - сообщение никуда не ушло, отправитель должен получить directfailed
+    bool sent = false;
+    for (const Peer &peer : qAsConst(_peers))
+    {
+        if (peer.node == 0 && peer.socket && peer.socket->state() == QAbstractSocket::ConnectedState)
+        {
+            peer.socket->write(frame);
+            sent = true;
+        }
+    }
+    return sent;
+}
+
+void ClusterNode::acceptPeers()
+{
+    while (QTcpSocket *socket = _server.nextPendingConnection())
+    {
+        _inbound.insert(socket, { new FrameReader, 0 });
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { readInbound(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]()
+        {
+            const Inbound inbound = _inbound.take(socket);
+            delete inbound.reader;
+            socket->deleteLater();
+            if (inbound.node != 0)
+                nodeDisconnected(inbound.node);
+        });
+    }
+}
+
+void ClusterNode::readInbound(QTcpSocket *socket)
+{
+    auto it = _inbound.find(socket);
+    if (it == _inbound.end())
+        return;
+
+    FrameReader *reader = it->reader;
+    reader->readFrom(socket);
+
+    const char *data = nullptr;
+    int size = 0;
+    while (reader->nextFrame(data, size))
+    {
+        QJsonParseError parseError;
+        const QJsonDocument doc = QJsonDocument::fromJson(QByteArray::fromRawData(data, size), &parseError);
+        if (parseError.error != QJsonParseError::NoError || !doc.isObject())
+        {
+            LOG_WARNING(QStringLiteral("invalid cluster message"));
+            continue;
+        }
+        processPeerMessage(socket, doc.object());
+    }
+}
+
+void ClusterNode::processPeerMessage(QTcpSocket *socket, const QJsonObject &message)
+{
+    const QString type = message.value(QLatin1String("type")).toString();
+    Inbound &inbound = _inbound[socket];
+
+    if (type == QLatin1String("hello"))
+    {
+        inbound.node = message.value(QLatin1String("node")).toString().toULongLong();
+        socket->write(helloFrame());
+        return;
+    }
+
+    // до представления узел неизвестен - его сообщения не принимаем
+    if (inbound.node == 0)
+        return;
+
+    if (type == QLatin1String("relay"))
+    {
+        const QJsonObject relayed = message.value(QLatin1String("message")).toObject();
+        const QJsonValue to = message.value(QLatin1String("to"));
+        if (to.isString())
+            emit directMessage(to.toString(), relayed);
+        else
+            emit roomMessage(message.value(QLatin1String("room")).toString(), relayed);
+    }
+    else if (type == QLatin1String("session"))
+    {
+        const QString nickname = message.value(QLatin1String("nickname")).toString();
+        if (message.value(QLatin1String("op")).toString() == QLatin1String("add"))
+            addRemoteSession(inbound.node, nickname);
+        else
+            removeRemoteSession(inbound.node, nickname);
+    }
+    else if (type == QLatin1String("sessions"))
+    {
+        applySnapshot(inbound.node, message.value(QLatin1String("nicknames")).toArray());
+    }
+}
+
+void ClusterNode::nodeDisconnected(quint64 node)
+{
+    // узел мог уже переподключиться новым соединением - тогда его пользователи остаются
+    if (isNodeConnected(node))
+        return;
+
+    QTimer::singleShot(NodeLossGraceMs, this, [this, node]()
+    {
+        if (isNodeConnected(node))
+            return;
+        const QStringList lost = dropNode(node);
+        LOG_WARNING(QStringLiteral("Cluster node %1 lost with %2 user(s)").arg(node, 16, 16, QLatin1Char('0')).arg(lost.size()));
+        if (!lost.isEmpty())
+            emit nodeLost(lost);
+    });
+}
+
+bool ClusterNode::isNodeConnected(quint64 node) const
+{
+    for (const Inbound &inbound : qAsConst(_inbound))
+    {
+        if (inbound.node == node)
+            return true;
+    }
+    return false;
+}
+
+void ClusterNode::applySnapshot(quint64 node, const QJsonArray &nicknames)
+{
+    // полный снимок заменяет все, что было известно об узле. разница со старым списком сообщается:
+    // после долгого обрыва или при первом подключении здесь еще не знают этих пользователей,
+    // а за время обрыва кто-то мог уйти без сообщения об этом
+    QHash<QString, QString> previous;
+    for (const QString &nickname : dropNode(node))
+        previous.insert(SessionRegistry::nicknameKey(nickname), nickname);
+
+    QStringList joined;
+    for (const QJsonValue &value : nicknames)
+    {
+        const QString nickname = value.toString();
+        if (nickname.isEmpty())
+            continue;
+        if (previous.remove(SessionRegistry::nicknameKey(nickname)) == 0)
+            joined.append(nickname);
+        addRemoteSession(node, nickname);
+    }
+
+    const QStringList left = previous.values();
+    if (!joined.isEmpty() || !left.isEmpty())
+        emit sessionsSynced(joined, left);
+}
+
+void ClusterNode::addRemoteSession(quint64 node, const QString &nickname)
+{
+    if (nickname.isEmpty())
+        return;
+
+    const QString key = SessionRegistry::nicknameKey(nickname);
+    _remoteNicknames.insert(key, node);
+    _nodeSessions[node].append(nickname);
+
+    // один ник заняли на двух узлах одновременно: остается пользователь узла с меньшим идентификатором,
+    // второй узел отключает своего (он получит наше add и решит так же)
+    if (_localSessions.contains(key) && node < _nodeId)
+        emit nicknameConflict(_localSessions.value(key));
+}
+
+void ClusterNode::removeRemoteSession(quint64 node, const QString &nickname)
+{
+    const QString key = SessionRegistry::nicknameKey(nickname);
+    if (_remoteNicknames.value(key) == node)
+        _remoteNicknames.remove(key);
+    _nodeSessions[node].removeOne(nickname);
+}
+
+QStringList ClusterNode::dropNode(quint64 node)
+{
+    const QStringList nicknames = _nodeSessions.take(node);
+    for (const QString &nickname : nicknames)
+    {
+        const QString key = SessionRegistry::nicknameKey(nickname);
+        if (_remoteNicknames.value(key) == node)
+            _remoteNicknames.remove(key);
+    }
+    return nicknames;
+}
+
+QByteArray ClusterNode::helloFrame() const
+{
+    QJsonObject hello;
+    hello[QStringLiteral("type")] = QStringLiteral("hello");
+    hello[QStringLiteral("node")] = QString::number(_nodeId);
+    return ServerWorker::encodeJson(hello);
+}
+
+QByteArray ClusterNode::sessionFrame(const char *op, const QString &nickname) const
+{
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("session");
+    message[QStringLiteral("op")] = QLatin1String(op);
+    message[QStringLiteral("nickname")] = nickname;
+    return ServerWorker::encodeJson(message);
+}
+
+QByteArray ClusterNode::snapshotFrame() const
+{
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("sessions");
+    message[QStringLiteral("nicknames")] = QJsonArray::fromStringList(_localSessions.values());
+    return ServerWorker::encodeJson(message);
+}
@@ -0,0 +1,93 @@
+#ifndef CLUSTERNODE_H
+#define CLUSTERNODE_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QTcpServer>
+#include <QVector>
+
+class QTcpSocket;
+class QJsonArray;
+class QJsonObject;
+class FrameReader;
+
+// узел кластера серверов: полная сеть tcp-соединений между процессами (у каждого узла в --peer перечислены все остальные).
+// исходящие соединения - для отправки, входящие - для приема; каждое сообщение уходит каждому узлу один раз,
+// а не каждому удаленному пользователю. узлы сообщают друг другу ники своих пользователей
+// (снимок при подключении, дальше добавления и удаления); рассылки пересылаются всем узлам,
+// личные сообщения - только узлу адресата (его идентификатор исходящее соединение узнает из ответа на hello)
+
+class ClusterNode : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(ClusterNode)
+
+public:
+    ClusterNode(const QHostAddress &address, quint16 port, const QStringList &peers, QObject *parent = nullptr);
+    ~ClusterNode();
+
+    bool start();
+    quint64 nodeId() const;
+
+    void announceSession(const QString &nickname);      // пользователь залогинился на этом узле
+    void withdrawSession(const QString &nickname);      // пользователь этого узла отключился
+    bool isNicknameTaken(const QString &nickname) const;// ник занят на другом узле
+
+    void relayToRoom(const QString &room, const QByteArray &jsonFrame);     // рассылка участникам комнаты на других узлах
+    bool relayDirect(const QString &nickname, const QByteArray &jsonFrame); // false - пользователя нет на других узлах или сообщение некуда отправить
+
+signals:
+    void roomMessage(const QString &room, const QJsonObject &message);
+    void directMessage(const QString &nickname, const QJsonObject &message);
+    void nicknameConflict(const QString &nickname);     // ник одновременно заняли на двух узлах, локальный пользователь проиграл
+    void nodeLost(const QStringList &nicknames);        // узел отключился вместе со своими пользователями
+    void sessionsSynced(const QStringList &joined, const QStringList &left); // снимок узла: о ком здесь не знали и кто ушел без связи
+
+private slots:
+    void acceptPeers();
+
+private:
+    struct Peer                                         // исходящее соединение к узлу из --peer
+    {
+        QString host;
+        quint16 port;
+        QTcpSocket *socket;
+        FrameReader *reader;                            // ответ узла на hello
+        quint64 node;                                   // 0 - узел еще не ответил на hello
+    };
+
+    struct Inbound                                      // входящее соединение от узла
+    {
+        FrameReader *reader;
+        quint64 node;                                   // 0 - узел еще не представился
+    };
+
+    void connectPeer(Peer &peer);
+    void readPeer(Peer &peer);
+    void sendToPeers(const QByteArray &frame);
+    void readInbound(QTcpSocket *socket);
+    void processPeerMessage(QTcpSocket *socket, const QJsonObject &message);
+    void addRemoteSession(quint64 node, const QString &nickname);
+    void removeRemoteSession(quint64 node, const QString &nickname);
+    QStringList dropNode(quint64 node);
+    void nodeDisconnected(quint64 node);
+    bool isNodeConnected(quint64 node) const;
+    void applySnapshot(quint64 node, const QJsonArray &nicknames);
+    QByteArray helloFrame() const;
+    QByteArray sessionFrame(const char *op, const QString &nickname) const;
+    QByteArray snapshotFrame() const;
+
+    QTcpServer _server;
+    QHostAddress _address;
+    quint16 _port;
+    quint64 _nodeId;
+    QVector<Peer> _peers;
+    QHash<QTcpSocket *, Inbound> _inbound;
+    QHash<QString, QString> _localSessions;             // ключ ника -> ник пользователей этого узла
+    QHash<QString, quint64> _remoteNicknames;           // ключ ника -> узел
+    QHash<quint64, QStringList> _nodeSessions;          // ники каждого удаленного узла
+};
+
+#endif // CLUSTERNODE_H
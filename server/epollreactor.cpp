@@ -0,0 +1,109 @@
+#include "epollreactor.h"
+#include "serverworker.h"
+#include <QSocketNotifier>
+
+#ifdef Q_OS_LINUX
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+// событий за один вызов epoll_wait; остальные придут на следующей итерации цикла событий
+static const int MaxEvents = 256;
+static const int ReadBufferSize = 64 * 1024;
+
+#ifdef Q_OS_LINUX
+
+EpollReactor::EpollReactor(QObject *parent)
+    : QObject(parent)
+    , _epollFd(epoll_create1(EPOLL_CLOEXEC))
+    , _notifier(nullptr)
+{
+}
+
+EpollReactor::~EpollReactor()
+{
+    if (_epollFd >= 0)
+        ::close(_epollFd);
+}
+
+bool EpollReactor::isSupported()
+{
+    return true;
+}
+
+bool EpollReactor::add(int fd, ServerWorker *worker)
+{
+    if (!_notifier)
+    {
+        _notifier = new QSocketNotifier(_epollFd, QSocketNotifier::Read, this);
+        connect(_notifier, &QSocketNotifier::activated, this, &EpollReactor::processEvents);
+        _readBuffer.resize(ReadBufferSize);
+    }
+
+    // EPOLLOUT регистрируется сразу: при edge-triggered событие приходит, только когда буфер сокета освобождается
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = worker;
+    return epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+void EpollReactor::remove(int fd)
+{
+    epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void EpollReactor::processEvents()
+{
+    // воркеры удаляются через deleteLater, поэтому указатели в пачке событий остаются действительными;
+    // события уже закрытого соединения воркер пропускает сам
+    epoll_event events[MaxEvents];
+    const int count = epoll_wait(_epollFd, events, MaxEvents, 0);
+    for (int i = 0; i < count; ++i)
+        static_cast<ServerWorker *>(events[i].data.ptr)->socketEvents(events[i].events);
+}
+
+#else
+
+EpollReactor::EpollReactor(QObject *parent)
+    : QObject(parent)
+    , _epollFd(-1)
+    , _notifier(nullptr)
+{
+}
+
+EpollReactor::~EpollReactor()
+{
+}
+
+bool EpollReactor::isSupported()
+{
+    return false;
+}
+
+bool EpollReactor::add(int fd, ServerWorker *worker)
+{
+    Q_UNUSED(fd)
+    Q_UNUSED(worker)
+    return false;
+}
+
+void EpollReactor::remove(int fd)
+{
+    Q_UNUSED(fd)
+}
+
+void EpollReactor::processEvents()
+{
+}
+
+#endif
+
+bool EpollReactor::isValid() const
+{
+    return _epollFd >= 0;
+}
+
+QByteArray &EpollReactor::readBuffer()
+{
+    return _readBuffer;
+}
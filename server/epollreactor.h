@@ -0,0 +1,40 @@
+#ifndef EPOLLREACTOR_H
+#define EPOLLREACTOR_H
+
+#include <QObject>
+#include <QByteArray>
+
+class QSocketNotifier;
+class ServerWorker;
+
+// edge-triggered epoll на дескрипторах клиентов одного потока ввода-вывода (только Linux).
+// цикл событий Qt следит за единственным дескриптором epoll, события раздаются воркерам напрямую,
+// без QTcpSocket и его уведомителей на каждое соединение
+
+class EpollReactor : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(EpollReactor)
+
+public:
+    explicit EpollReactor(QObject *parent = nullptr);
+    ~EpollReactor();
+
+    static bool isSupported();                          // backend доступен на этой платформе
+    bool isValid() const;
+
+    // вызываются только из потока реактора
+    bool add(int fd, ServerWorker *worker);
+    void remove(int fd);
+    QByteArray &readBuffer();                           // буфер чтения, общий для всех соединений потока
+
+private slots:
+    void processEvents();
+
+private:
+    int _epollFd;
+    QSocketNotifier *_notifier;                         // создается в потоке реактора при первом add()
+    QByteArray _readBuffer;
+};
+
+#endif // EPOLLREACTOR_H
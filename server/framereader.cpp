@@ -0,0 +1,112 @@
+#include "framereader.h"
+#include <QIODevice>
+#include <QtEndian>
+#include <cstring>
+
+FrameReader::FrameReader(int initialCapacity)
+    : _offset(0)
+{
+    if (initialCapacity > 0)
+        reserve(initialCapacity);
+}
+
+qint64 FrameReader::readFrom(QIODevice *device)
+{
+    const qint64 available = device->bytesAvailable();
+    if (available <= 0)
+        return 0;
+
+    prepareTail(int(available));
+    const int oldSize = _buffer.size();
+    _buffer.resize(oldSize + int(available));
+    const qint64 read = device->read(_buffer.data() + oldSize, available);
+    _buffer.resize(oldSize + int(qMax<qint64>(0, read)));
+    return read;
+}
+
+void FrameReader::append(const char *data, int size)
+{
+    if (size <= 0)
+        return;
+
+    prepareTail(size);
+    _buffer.append(data, size);
+}
+
+bool FrameReader::nextFrame(const char *&data, int &size)
+{
+    const int used = frameAt(_buffer.constData() + _offset, _buffer.size() - _offset, data, size);
+    _offset += used;
+    return used > 0;
+}
+
+bool FrameReader::peekFrame(const char *&data, int &size) const
+{
+    return frameAt(_buffer.constData() + _offset, _buffer.size() - _offset, data, size) > 0;
+}
+
+int FrameReader::frameAt(const char *buffer, int available, const char *&data, int &size)
+{
+    const qint64 length = frameLength(buffer, available);
+    if (length < 0 || qint64(available) - qint64(sizeof(quint32)) < length)
+        return 0;
+
+    data = buffer + sizeof(quint32);
+    size = int(length);
+    return int(sizeof(quint32)) + size;
+}
+
+qint64 FrameReader::frameLength(const char *buffer, int available)
+{
+    if (available < int(sizeof(quint32)))
+        return -1;
+
+    // 0xFFFFFFFF - так QDataStream записывает пустой (null) QByteArray
+    const quint32 length = qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(buffer));
+    return length == 0xFFFFFFFFu ? 0 : qint64(length);
+}
+
+qint64 FrameReader::nextFrameLength() const
+{
+    return frameLength(_buffer.constData() + _offset, _buffer.size() - _offset);
+}
+
+int FrameReader::buffered() const
+{
+    return _buffer.size() - _offset;
+}
+
+void FrameReader::reserve(int capacity)
+{
+    // reserve() запрещает QByteArray освобождать память при resize(0) - буфер живет все время соединения
+    _buffer.reserve(capacity);
+}
+
+void FrameReader::squeeze()
+{
+    if (_offset == _buffer.size())
+    {
+        _buffer.clear();
+        _offset = 0;
+    }
+}
+
+void FrameReader::prepareTail(int required)
+{
+    // всё разобрано - начинаем буфер сначала, память остается за буфером
+    if (_offset == _buffer.size())
+    {
+        _buffer.resize(0);
+        _offset = 0;
+        return;
+    }
+
+    // сдвигаем неразобранный хвост в начало, если разобранная часть велика или в конце не хватает места
+    if (_offset > 0 && (_offset >= _buffer.size() / 2 || _buffer.capacity() - _buffer.size() < required))
+    {
+        const int remaining = _buffer.size() - _offset;
+        memmove(_buffer.data(), _buffer.constData() + _offset, size_t(remaining));
+        _buffer.resize(remaining);
+        _offset = 0;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef FRAMEREADER_H
+#define FRAMEREADER_H
+
+#include <QByteArray>
+
+class QIODevice;
+
+// разбор входящих фреймов (длина quint32 big-endian + данные, как у QDataStream << QByteArray)
+// прямо в буфере соединения: буфер переиспользуется между чтениями, фреймы не копируются.
+// неразобранный хвост сдвигается в начало буфера, когда разобранная часть становится больше половины
+
+class FrameReader
+{
+public:
+    explicit FrameReader(int initialCapacity = 64 * 1024);
+
+    qint64 readFrom(QIODevice *device);                 // дочитать все доступные данные устройства
+    void append(const char *data, int size);
+
+    // следующий полный фрейм; указатель действителен до следующего readFrom/append
+    bool nextFrame(const char *&data, int &size);
+    bool peekFrame(const char *&data, int &size) const; // то же без продвижения - фрейм остается в буфере
+
+    qint64 nextFrameLength() const;                     // длина следующего фрейма по префиксу, -1 - префикс еще не пришел
+    int buffered() const;                               // байт в буфере, еще не разобранных во фреймы
+    void reserve(int capacity);                         // буфер сохраняет память между чтениями
+    void squeeze();                                     // освободить память, если в буфере ничего не осталось
+
+    // полный фрейм в начале чужого буфера: возвращает количество занятых им байт, 0 - фрейм еще не пришел целиком
+    static int frameAt(const char *buffer, int available, const char *&data, int &size);
+    static qint64 frameLength(const char *buffer, int available);
+
+private:
+    void prepareTail(int required);
+
+    QByteArray _buffer;
+    int _offset;                                        // начало неразобранных данных
+};
+
+#endif // FRAMEREADER_H
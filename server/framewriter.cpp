@@ -0,0 +1,153 @@
+#include "framewriter.h"
+#include <QtEndian>
+#include <cstdio>
+#include <cstring>
+
+// буфер потока: резервируется один раз и не освобождается при resize(0)
+static const int ArenaCapacity = 16 * 1024;
+static thread_local QByteArray arena;
+static thread_local bool arenaBusy = false;
+
+static void appendString(QByteArray &out, const QString &value)
+{
+    // экранирование по json и перевод utf-16 -> utf-8 за один проход
+    out.append('"');
+    const ushort *data = value.utf16();
+    const int size = value.size();
+    for (int i = 0; i < size; ++i)
+    {
+        const ushort c = data[i];
+        if (c < 0x80)
+        {
+            switch (c)
+            {
+            case '"': out.append("\\\"", 2); break;
+            case '\\': out.append("\\\\", 2); break;
+            case '\n': out.append("\\n", 2); break;
+            case '\r': out.append("\\r", 2); break;
+            case '\t': out.append("\\t", 2); break;
+            case '\b': out.append("\\b", 2); break;
+            case '\f': out.append("\\f", 2); break;
+            default:
+                if (c < 0x20)
+                {
+                    char escaped[7];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out.append(escaped, 6);
+                }
+                else
+                {
+                    out.append(char(c));
+                }
+            }
+        }
+        else if (c < 0x800)
+        {
+            out.append(char(0xC0 | (c >> 6)));
+            out.append(char(0x80 | (c & 0x3F)));
+        }
+        else if (QChar::isHighSurrogate(c) && i + 1 < size && QChar::isLowSurrogate(data[i + 1]))
+        {
+            const uint ucs4 = QChar::surrogateToUcs4(c, data[++i]);
+            out.append(char(0xF0 | (ucs4 >> 18)));
+            out.append(char(0x80 | ((ucs4 >> 12) & 0x3F)));
+            out.append(char(0x80 | ((ucs4 >> 6) & 0x3F)));
+            out.append(char(0x80 | (ucs4 & 0x3F)));
+        }
+        else
+        {
+            // одиночная половинка суррогатной пары - заменяем на U+FFFD, как QString::toUtf8
+            const ushort code = QChar::isSurrogate(c) ? 0xFFFD : c;
+            out.append(char(0xE0 | (code >> 12)));
+            out.append(char(0x80 | ((code >> 6) & 0x3F)));
+            out.append(char(0x80 | (code & 0x3F)));
+        }
+    }
+    out.append('"');
+}
+
+FrameWriter::FrameWriter()
+    : _buffer(&_local)
+    , _ownsArena(false)
+{
+    if (!arenaBusy)
+    {
+        arenaBusy = true;
+        _ownsArena = true;
+        if (arena.capacity() < ArenaCapacity)
+            arena.reserve(ArenaCapacity);
+        _buffer = &arena;
+    }
+
+    // место под префикс длины, заполняется в frame()
+    _buffer->resize(int(sizeof(quint32)));
+    _buffer->append('{');
+}
+
+FrameWriter::~FrameWriter()
+{
+    if (_ownsArena)
+    {
+        arena.resize(0);
+        arenaBusy = false;
+    }
+}
+
+FrameWriter &FrameWriter::add(QLatin1String key, const QString &value)
+{
+    appendKey(key);
+    appendString(*_buffer, value);
+    return *this;
+}
+
+FrameWriter &FrameWriter::add(QLatin1String key, QLatin1String value)
+{
+    // литералы вида "message" пишутся как есть, остальное - через общее экранирование
+    for (const char c : value)
+    {
+        if (uchar(c) < 0x20 || uchar(c) >= 0x80 || c == '"' || c == '\\')
+            return add(key, QString(value));
+    }
+
+    appendKey(key);
+    _buffer->append('"');
+    _buffer->append(value.data(), value.size());
+    _buffer->append('"');
+    return *this;
+}
+
+FrameWriter &FrameWriter::add(QLatin1String key, qint64 value)
+{
+    appendKey(key);
+    char digits[24];
+    const int length = std::snprintf(digits, sizeof(digits), "%lld", static_cast<long long>(value));
+    _buffer->append(digits, length);
+    return *this;
+}
+
+FrameWriter &FrameWriter::addJson(QLatin1String key, const char *json, int size)
+{
+    appendKey(key);
+    _buffer->append(json, size);
+    return *this;
+}
+
+QByteArray FrameWriter::frame() const
+{
+    // копия в точный размер - единственное выделение памяти на сообщение
+    const int size = _buffer->size() + 1;
+    QByteArray result(size, Qt::Uninitialized);
+    memcpy(result.data(), _buffer->constData(), size_t(size - 1));
+    result[size - 1] = '}';
+    qToBigEndian<quint32>(quint32(size - int(sizeof(quint32))), result.data());
+    return result;
+}
+
+void FrameWriter::appendKey(QLatin1String key)
+{
+    if (_buffer->size() > int(sizeof(quint32)) + 1)
+        _buffer->append(',');
+    _buffer->append('"');
+    _buffer->append(key.data(), key.size());
+    _buffer->append("\":", 2);
+}
@@ -0,0 +1,35 @@
+#ifndef FRAMEWRITER_H
+#define FRAMEWRITER_H
+
+#include <QByteArray>
+#include <QString>
+
+// сборка json-фрейма (префикс длины + компактный json) без QJsonObject и промежуточных строк:
+// текст пишется в буфер потока, который переиспользуется от сообщения к сообщению,
+// на сообщение остается одно выделение памяти - под готовый фрейм.
+// ключи - латинские литералы без экранирования
+
+class FrameWriter
+{
+    Q_DISABLE_COPY(FrameWriter)
+
+public:
+    FrameWriter();
+    ~FrameWriter();
+
+    FrameWriter &add(QLatin1String key, const QString &value);
+    FrameWriter &add(QLatin1String key, QLatin1String value);
+    FrameWriter &add(QLatin1String key, qint64 value);
+    FrameWriter &addJson(QLatin1String key, const char *json, int size);   // значение - уже готовый json
+
+    QByteArray frame() const;                           // готовый фрейм, как ServerWorker::encodeJson
+
+private:
+    void appendKey(QLatin1String key);
+
+    QByteArray _local;                                  // если буфер потока занят другим FrameWriter
+    QByteArray *_buffer;
+    bool _ownsArena;
+};
+
+#endif // FRAMEWRITER_H
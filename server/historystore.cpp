@@ -0,0 +1,234 @@
+#include "historystore.h"
+#include "logger.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+#include <cstring>
+
+HistoryStore::HistoryStore(int ringCapacity, qint64 segmentSize, int maxSegments)
+    : _segmentSize(segmentSize)
+    , _maxSegments(qMax(1, maxSegments))
+    , _ring(qMax(1, ringCapacity))
+    , _ringCount(0)
+    , _nextSequence(1)
+{
+}
+
+HistoryStore::~HistoryStore()
+{
+    for (Segment &segment : _segments)
+        closeSegment(segment);
+}
+
+bool HistoryStore::open(const QString &directory)
+{
+    QDir dir(directory);
+    if (!dir.mkpath(QStringLiteral(".")))
+    {
+        LOG_ERROR(QLatin1String("history: cannot create directory ") + directory);
+        return false;
+    }
+    _directory = dir.absolutePath();
+
+    // сегменты названы номером первого сообщения с ведущими нулями - сортировка по имени дает порядок
+    const QStringList files = dir.entryList(QStringList() << QStringLiteral("*.log"), QDir::Files, QDir::Name);
+    for (const QString &fileName : files)
+    {
+        Segment segment;
+        segment.firstSequence = fileName.left(fileName.size() - 4).toULongLong();
+        const QString path = dir.filePath(fileName);
+        if (segment.firstSequence == 0 || !mapSegment(segment, path, QFileInfo(path).size()))
+            continue;
+
+        scanSegment(segment);
+        _segments.append(segment);
+    }
+
+    if (!_segments.isEmpty())
+    {
+        const Segment &last = _segments.constLast();
+        _nextSequence = last.firstSequence + quint64(last.offsets.size());
+    }
+
+    // последние сообщения с диска сразу попадают в кольцевой буфер
+    const int ringLoad = int(qMin<quint64>(quint64(_ring.size()), _nextSequence - firstSequence()));
+    const quint64 ringFrom = _nextSequence - quint64(ringLoad);
+    const QByteArray tail = readRange(ringFrom, _nextSequence);
+    int offset = 0;
+    for (quint64 sequence = ringFrom; sequence < _nextSequence && offset < tail.size(); ++sequence)
+    {
+        const int frameSize = int(sizeof(quint32)) + int(qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(tail.constData() + offset)));
+        _ring[int(sequence % quint64(_ring.size()))] = tail.mid(offset, frameSize);
+        offset += frameSize;
+        ++_ringCount;
+    }
+
+    LOG_INFO(QStringLiteral("history: %1 messages in %2 segments").arg(_nextSequence - firstSequence()).arg(_segments.size()));
+    return true;
+}
+
+quint64 HistoryStore::nextSequence() const
+{
+    return _nextSequence;
+}
+
+quint64 HistoryStore::firstSequence() const
+{
+    if (!_segments.isEmpty())
+        return _segments.constFirst().firstSequence;
+    return _nextSequence - quint64(_ringCount);
+}
+
+void HistoryStore::append(const QByteArray &frame)
+{
+    // фрейм разделяется с рассылкой - в кольцевом буфере копии не создается
+    _ring[int(_nextSequence % quint64(_ring.size()))] = frame;
+    _ringCount = qMin(_ringCount + 1, _ring.size());
+
+    // на диск - в текущий сегмент; после последнего фрейма должно остаться место под нулевую длину-терминатор
+    if (!_directory.isEmpty())
+    {
+        // новый сегмент, если в текущем нет места (или в нумерации текущего сегмента пропуск)
+        const qint64 required = frame.size() + qint64(sizeof(quint32));
+        bool writable = !_segments.isEmpty()
+                && _segments.constLast().used + required <= _segments.constLast().capacity
+                && _segments.constLast().firstSequence + quint64(_segments.constLast().offsets.size()) == _nextSequence;
+        if (!writable)
+            writable = createSegment(_nextSequence, qMax(_segmentSize, required));
+
+        if (writable)
+        {
+            Segment &segment = _segments.last();
+            memcpy(segment.data + segment.used, frame.constData(), size_t(frame.size()));
+            segment.offsets.append(segment.used);
+            segment.used += frame.size();
+        }
+    }
+
+    ++_nextSequence;
+}
+
+QByteArray HistoryStore::recent(int count) const
+{
+    return before(_nextSequence, count);
+}
+
+QByteArray HistoryStore::before(quint64 sequence, int count) const
+{
+    const quint64 to = qMin(sequence, _nextSequence);
+    const quint64 first = firstSequence();
+    if (count <= 0 || to <= first)
+        return QByteArray();
+
+    const quint64 from = qMax(first, to - qMin(to, quint64(count)));
+
+    // недавние сообщения берем из памяти, более старые - из сегментов на диске
+    const quint64 ringFirst = _nextSequence - quint64(_ringCount);
+    if (from < ringFirst)
+        return readRange(from, to);
+
+    int size = 0;
+    for (quint64 s = from; s < to; ++s)
+        size += _ring.at(int(s % quint64(_ring.size()))).size();
+
+    QByteArray result;
+    result.reserve(size);
+    for (quint64 s = from; s < to; ++s)
+        result.append(_ring.at(int(s % quint64(_ring.size()))));
+    return result;
+}
+
+QByteArray HistoryStore::readRange(quint64 from, quint64 to) const
+{
+    // фреймы внутри сегмента лежат подряд - из каждого сегмента копируем один непрерывный кусок
+    QByteArray result;
+    for (const Segment &segment : _segments)
+    {
+        const quint64 segmentEnd = segment.firstSequence + quint64(segment.offsets.size());
+        if (segmentEnd <= from || segment.firstSequence >= to)
+            continue;
+
+        const int firstIndex = int(qMax(from, segment.firstSequence) - segment.firstSequence);
+        const int lastIndex = int(qMin(to, segmentEnd) - segment.firstSequence);
+        const qint64 begin = segment.offsets.at(firstIndex);
+        const qint64 end = lastIndex < segment.offsets.size() ? segment.offsets.at(lastIndex) : segment.used;
+        result.append(reinterpret_cast<const char *>(segment.data + begin), int(end - begin));
+    }
+    return result;
+}
+
+bool HistoryStore::createSegment(quint64 firstSequence, qint64 capacity)
+{
+    Segment segment;
+    segment.firstSequence = firstSequence;
+    const QString path = QDir(_directory).filePath(QStringLiteral("%1.log").arg(firstSequence, 20, 10, QLatin1Char('0')));
+    if (!mapSegment(segment, path, capacity))
+        return false;
+
+    _segments.append(segment);
+
+    // ограничиваем количество сегментов - самый старый удаляется вместе с файлом
+    while (_segments.size() > _maxSegments)
+    {
+        Segment oldest = _segments.takeFirst();
+        const QString oldPath = oldest.file->fileName();
+        closeSegment(oldest);
+        QFile::remove(oldPath);
+    }
+    return true;
+}
+
+bool HistoryStore::mapSegment(Segment &segment, const QString &path, qint64 capacity)
+{
+    // файл сегмента сразу растягивается до полного размера и заполнен нулями
+    QFile *file = new QFile(path);
+    if (!file->open(QIODevice::ReadWrite) || capacity <= 0 || (file->size() < capacity && !file->resize(capacity)))
+    {
+        LOG_ERROR(QLatin1String("history: cannot open segment ") + path);
+        delete file;
+        return false;
+    }
+
+    uchar *data = file->map(0, capacity);
+    if (!data)
+    {
+        LOG_ERROR(QLatin1String("history: cannot map segment ") + path);
+        delete file;
+        return false;
+    }
+
+    segment.file = file;
+    segment.data = data;
+    segment.capacity = capacity;
+    segment.used = 0;
+    return true;
+}
+
+void HistoryStore::scanSegment(Segment &segment) const
+{
+    // проходим фреймы до нулевой длины или конца файла
+    qint64 offset = 0;
+    while (offset + qint64(sizeof(quint32)) <= segment.capacity)
+    {
+        const quint32 length = qFromBigEndian<quint32>(segment.data + offset);
+        if (length == 0 || offset + qint64(sizeof(quint32)) + length > segment.capacity)
+            break;
+
+        segment.offsets.append(offset);
+        offset += qint64(sizeof(quint32)) + length;
+    }
+    segment.used = offset;
+}
+
+void HistoryStore::closeSegment(Segment &segment)
+{
+    if (!segment.file)
+        return;
+
+    segment.file->unmap(segment.data);
+    segment.file->close();
+    delete segment.file;
+    segment.file = nullptr;
+    segment.data = nullptr;
+}
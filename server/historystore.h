@@ -0,0 +1,60 @@
+#ifndef HISTORYSTORE_H
+#define HISTORYSTORE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+class QFile;
+
+// история сообщений общей комнаты:
+// журнал только на дозапись, разбитый на сегменты-файлы, отображенные в память (QFile::map),
+// и кольцевой буфер последних сообщений в памяти.
+// сообщения хранятся готовыми фреймами (длина + json), поэтому диапазон истории -
+// это несколько соседних фреймов, которые отправляются клиенту одной записью.
+// порядковые номера сообщений начинаются с 1, номер = первый номер сегмента + индекс в сегменте
+
+class HistoryStore
+{
+    Q_DISABLE_COPY(HistoryStore)
+
+public:
+    HistoryStore(int ringCapacity, qint64 segmentSize, int maxSegments);
+    ~HistoryStore();
+
+    bool open(const QString &directory);            // без открытого каталога история хранится только в памяти
+    quint64 nextSequence() const;                   // номер, который получит следующее сообщение
+    quint64 firstSequence() const;                  // самое старое доступное сообщение
+    void append(const QByteArray &frame);           // фрейм сообщения с номером nextSequence()
+
+    QByteArray recent(int count) const;             // последние count фреймов одним буфером
+    QByteArray before(quint64 sequence, int count) const;   // count фреймов перед sequence одним буфером
+
+private:
+    struct Segment
+    {
+        quint64 firstSequence = 0;
+        QFile *file = nullptr;
+        uchar *data = nullptr;
+        qint64 capacity = 0;
+        qint64 used = 0;
+        QVector<qint64> offsets;                    // смещение каждого фрейма в сегменте
+    };
+
+    bool createSegment(quint64 firstSequence, qint64 capacity);
+    bool mapSegment(Segment &segment, const QString &path, qint64 capacity);
+    void scanSegment(Segment &segment) const;       // восстановление смещений фреймов при запуске
+    void closeSegment(Segment &segment);
+    QByteArray readRange(quint64 from, quint64 to) const;   // фреймы [from, to) с диска
+
+    QString _directory;
+    QVector<Segment> _segments;
+    qint64 _segmentSize;
+    int _maxSegments;
+
+    QVector<QByteArray> _ring;                      // последние сообщения, индекс = номер % размер
+    int _ringCount;
+    quint64 _nextSequence;
+};
+
+#endif // HISTORYSTORE_H
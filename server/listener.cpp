@@ -0,0 +1,161 @@
+#include "listener.h"
+#include "logger.h"
+#include <QHostAddress>
+#include <QSocketNotifier>
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#endif
+
+Listener::Listener(int fd, int acceptBatch, QObject *parent)
+    : QObject(parent)
+    , _fd(fd)
+    , _acceptBatch(qMax(1, acceptBatch))
+    , _notifier(nullptr)
+{
+}
+
+void Listener::start()
+{
+    if (_fd < 0 || _notifier)
+        return;
+
+    // уведомитель создается в потоке слушателя, чтобы accept выполнялся там же
+    _notifier = new QSocketNotifier(_fd, QSocketNotifier::Read, this);
+    connect(_notifier, &QSocketNotifier::activated, this, &Listener::acceptPending);
+}
+
+#ifdef Q_OS_LINUX
+
+Listener::~Listener()
+{
+    if (_fd >= 0)
+        ::close(_fd);
+}
+
+bool Listener::isSupported()
+{
+    return true;
+}
+
+int Listener::openSocket(const QHostAddress &address, quint16 port, int backlog, bool reusePort)
+{
+    // Any - двойной стек через ipv6-сокет, остальные адреса - своего семейства
+    const bool ipv6 = address.protocol() == QAbstractSocket::IPv6Protocol || address == QHostAddress::Any;
+    sockaddr_storage storage;
+    memset(&storage, 0, sizeof(storage));
+    socklen_t length = 0;
+    if (ipv6)
+    {
+        sockaddr_in6 *addr = reinterpret_cast<sockaddr_in6 *>(&storage);
+        addr->sin6_family = AF_INET6;
+        addr->sin6_port = htons(port);
+        if (address != QHostAddress::Any)
+        {
+            const Q_IPV6ADDR ip = address.toIPv6Address();
+            memcpy(&addr->sin6_addr, &ip, sizeof(ip));
+        }
+        length = sizeof(sockaddr_in6);
+    }
+    else
+    {
+        sockaddr_in *addr = reinterpret_cast<sockaddr_in *>(&storage);
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(port);
+        addr->sin_addr.s_addr = htonl(address.toIPv4Address());
+        length = sizeof(sockaddr_in);
+    }
+
+    const int fd = ::socket(storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (reusePort && ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0)
+    {
+        LOG_ERROR(QStringLiteral("SO_REUSEPORT: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        ::close(fd);
+        return -1;
+    }
+    if (ipv6)
+    {
+        int v6only = address == QHostAddress::AnyIPv6 ? 1 : 0;
+        ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+    }
+
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&storage), length) != 0 || ::listen(fd, backlog) != 0)
+    {
+        LOG_ERROR(QStringLiteral("Cannot listen %1:%2 - %3").arg(address.toString()).arg(port).arg(QString::fromLocal8Bit(strerror(errno))));
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void Listener::closeSocket(int fd)
+{
+    if (fd >= 0)
+        ::close(fd);
+}
+
+void Listener::acceptPending()
+{
+    // принимаем до _acceptBatch соединений; если в очереди остались еще, уведомитель сработает снова,
+    // и другие события потока не ждут, пока разберется весь шторм подключений
+    QVector<int> descriptors;
+    descriptors.reserve(_acceptBatch);
+    while (descriptors.size() < _acceptBatch)
+    {
+        const int fd = ::accept4(_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd >= 0)
+        {
+            descriptors.append(fd);
+            continue;
+        }
+        if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            LOG_WARNING(QStringLiteral("accept: %1").arg(QString::fromLocal8Bit(strerror(errno))));
+        break;
+    }
+
+    if (!descriptors.isEmpty())
+        emit accepted(descriptors);
+}
+
+#else
+
+Listener::~Listener()
+{
+}
+
+bool Listener::isSupported()
+{
+    return false;
+}
+
+int Listener::openSocket(const QHostAddress &address, quint16 port, int backlog, bool reusePort)
+{
+    Q_UNUSED(address)
+    Q_UNUSED(port)
+    Q_UNUSED(backlog)
+    Q_UNUSED(reusePort)
+    return -1;
+}
+
+void Listener::closeSocket(int fd)
+{
+    Q_UNUSED(fd)
+}
+
+void Listener::acceptPending()
+{
+}
+
+#endif
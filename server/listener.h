@@ -0,0 +1,43 @@
+#ifndef LISTENER_H
+#define LISTENER_H
+
+#include <QObject>
+#include <QVector>
+
+class QHostAddress;
+class QSocketNotifier;
+
+// слушающий сокет, открытый напрямую (только Linux): настраиваемая очередь listen и SO_REUSEPORT.
+// с SO_REUSEPORT у каждого потока ввода-вывода свой слушатель на том же порту, и ядро само раскладывает
+// входящие соединения между ними. за одно пробуждение принимается пачка соединений,
+// в поток сервера уходит один сигнал на всю пачку
+
+class Listener : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(Listener)
+
+public:
+    Listener(int fd, int acceptBatch, QObject *parent = nullptr);
+    ~Listener();
+
+    static bool isSupported();                          // слушатели доступны на этой платформе
+    static int openSocket(const QHostAddress &address, quint16 port, int backlog, bool reusePort); // -1 - ошибка
+    static void closeSocket(int fd);                    // сокет openSocket, не отданный слушателю
+
+public slots:
+    void start();                                       // вызывается в потоке слушателя
+
+signals:
+    void accepted(const QVector<int> &descriptors);
+
+private slots:
+    void acceptPending();
+
+private:
+    int _fd;
+    int _acceptBatch;                                   // сколько соединений принимать за одно пробуждение
+    QSocketNotifier *_notifier;
+};
+
+#endif // LISTENER_H
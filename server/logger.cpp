@@ -0,0 +1,173 @@
+#include "logger.h"
+#include <QThread>
+#include <QDebug>
+
+QAtomicInteger<int> Logger::_level(int(LogLevel::Info));
+
+Logger &Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+    : _slots(new Slot[Capacity])
+    , _enqueuePos(0)
+    , _dequeuePos(0)
+    , _dropped(0)
+    , _running(1)
+    , _writer(nullptr)
+{
+    // номер ячейки = позиция, в которую в нее можно писать
+    for (quintptr i = 0; i < Capacity; ++i)
+        _slots[i].sequence.storeRelaxed(i);
+
+    _writer = QThread::create([this]() { run(); });
+    _writer->setObjectName(QStringLiteral("log-writer"));
+    _writer->start(QThread::LowPriority);
+}
+
+Logger::~Logger()
+{
+    stop();
+    delete _writer;
+    delete[] _slots;
+}
+
+bool Logger::isEnabled(LogLevel level)
+{
+    return int(level) >= _level.loadRelaxed();
+}
+
+void Logger::setLevel(LogLevel level)
+{
+    _level.storeRelaxed(int(level));
+}
+
+LogLevel Logger::levelFromString(const QString &name, LogLevel defaultLevel)
+{
+    if (name.compare(QLatin1String("debug"), Qt::CaseInsensitive) == 0)
+        return LogLevel::Debug;
+    if (name.compare(QLatin1String("info"), Qt::CaseInsensitive) == 0)
+        return LogLevel::Info;
+    if (name.compare(QLatin1String("warning"), Qt::CaseInsensitive) == 0)
+        return LogLevel::Warning;
+    if (name.compare(QLatin1String("error"), Qt::CaseInsensitive) == 0)
+        return LogLevel::Error;
+    if (name.compare(QLatin1String("off"), Qt::CaseInsensitive) == 0)
+        return LogLevel::Off;
+    return defaultLevel;
+}
+
+void Logger::write(LogLevel level, const QString &message)
+{
+    if (!push(level, message))
+        _dropped.fetchAndAddRelaxed(1);
+}
+
+qint64 Logger::droppedMessages() const
+{
+    return _dropped.loadRelaxed();
+}
+
+void Logger::stop()
+{
+    if (!_running.testAndSetRelaxed(1, 0))
+        return;
+    _writer->wait();
+}
+
+bool Logger::push(LogLevel level, const QString &message)
+{
+    // ограниченная очередь Вьюкова: производитель захватывает позицию через CAS,
+    // заполняет ячейку и публикует ее, сдвигая sequence
+
+    quintptr pos = _enqueuePos.loadRelaxed();
+    Slot *slot = nullptr;
+    for (;;)
+    {
+        slot = &_slots[pos & (Capacity - 1)];
+        const quintptr sequence = slot->sequence.loadAcquire();
+        const qintptr diff = qintptr(sequence) - qintptr(pos);
+
+        if (diff == 0)
+        {
+            if (_enqueuePos.testAndSetRelaxed(pos, pos + 1, pos))
+                break;
+        }
+        else if (diff < 0)
+        {
+            return false;   // буфер заполнен
+        }
+        else
+        {
+            pos = _enqueuePos.loadRelaxed();
+        }
+    }
+
+    slot->level = level;
+    slot->text = message;
+    slot->sequence.storeRelease(pos + 1);
+    return true;
+}
+
+bool Logger::pop(LogLevel &level, QString &message)
+{
+    Slot *slot = &_slots[_dequeuePos & (Capacity - 1)];
+    const quintptr sequence = slot->sequence.loadAcquire();
+    if (qintptr(sequence) - qintptr(_dequeuePos + 1) < 0)
+        return false;       // буфер пуст
+
+    level = slot->level;
+    message = slot->text;
+    slot->text = QString();
+    slot->sequence.storeRelease(_dequeuePos + Capacity);
+    ++_dequeuePos;
+    return true;
+}
+
+void Logger::run()
+{
+    LogLevel level;
+    QString message;
+    qint64 reportedDrops = 0;
+
+    for (;;)
+    {
+        const bool running = _running.loadRelaxed();
+        bool written = false;
+
+        while (pop(level, message))
+        {
+            written = true;
+            switch (level)
+            {
+            case LogLevel::Debug:
+                qDebug().noquote() << message;
+                break;
+            case LogLevel::Info:
+                qInfo().noquote() << message;
+                break;
+            case LogLevel::Warning:
+                qWarning().noquote() << message;
+                break;
+            default:
+                qCritical().noquote() << message;
+                break;
+            }
+        }
+
+        const qint64 drops = _dropped.loadRelaxed();
+        if (drops != reportedDrops)
+        {
+            qWarning().noquote() << QStringLiteral("logger: %1 messages dropped").arg(drops - reportedDrops);
+            reportedDrops = drops;
+        }
+
+        // после остановки выводим остаток буфера и выходим
+        if (!running)
+            break;
+        if (!written)
+            QThread::msleep(5);
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QAtomicInteger>
+#include <QString>
+
+class QThread;
+
+// уровни логирования
+enum class LogLevel
+{
+    Debug = 0,
+    Info = 1,
+    Warning = 2,
+    Error = 3,
+    Off = 4
+};
+
+// уровни ниже CHAT_LOG_MIN_LEVEL вырезаются при компиляции (например, DEFINES += CHAT_LOG_MIN_LEVEL=1)
+#ifndef CHAT_LOG_MIN_LEVEL
+#define CHAT_LOG_MIN_LEVEL 0
+#endif
+
+// сообщение формируется только если уровень включен - выключенный уровень стоит одного сравнения
+#define CHAT_LOG(level, message) \
+    do { \
+        if (int(level) >= CHAT_LOG_MIN_LEVEL && Logger::isEnabled(level)) \
+            Logger::instance().write(level, message); \
+    } while (false)
+
+#define LOG_DEBUG(message) CHAT_LOG(LogLevel::Debug, message)
+#define LOG_INFO(message) CHAT_LOG(LogLevel::Info, message)
+#define LOG_WARNING(message) CHAT_LOG(LogLevel::Warning, message)
+#define LOG_ERROR(message) CHAT_LOG(LogLevel::Error, message)
+
+// асинхронный логгер: потоки кладут строки в lock-free кольцевой буфер,
+// фоновый поток выводит их через qDebug/qInfo/qWarning/qCritical.
+// при переполнении буфера строка выбрасывается - потоки ввода-вывода никогда не ждут вывода
+
+class Logger
+{
+    Q_DISABLE_COPY(Logger)
+
+public:
+    static Logger &instance();
+
+    static bool isEnabled(LogLevel level);
+    static void setLevel(LogLevel level);
+    static LogLevel levelFromString(const QString &name, LogLevel defaultLevel);
+
+    void write(LogLevel level, const QString &message);
+    void stop();                                        // вывести оставшиеся строки и остановить фоновый поток
+    qint64 droppedMessages() const;
+
+private:
+    Logger();
+    ~Logger();
+
+    struct Slot
+    {
+        QAtomicInteger<quintptr> sequence;
+        LogLevel level;
+        QString text;
+    };
+
+    bool push(LogLevel level, const QString &message);  // вызывается из любого потока
+    bool pop(LogLevel &level, QString &message);        // вызывается только из фонового потока
+    void run();
+
+    static QAtomicInteger<int> _level;
+
+    static const quintptr Capacity = 8192;              // степень двойки
+    Slot *_slots;
+    QAtomicInteger<quintptr> _enqueuePos;
+    quintptr _dequeuePos;
+    QAtomicInteger<qint64> _dropped;
+    QAtomicInteger<int> _running;
+    QThread *_writer;
+};
+
+#endif // LOGGER_H
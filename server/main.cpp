@@ -1,15 +1,162 @@
 #include <QCoreApplication>
+#include <QCommandLineParser>
 #include "myserver.h"
+#include "serversettings.h"
+#include "logger.h"
 #include <locale>
+#ifdef Q_OS_WIN
+#include <io.h>
 #include <fcntl.h>
+#endif
 
 int main(int argc, char *argv[])
 {
+#ifdef Q_OS_WIN
+    // консоль windows: русский текст лога в utf-16
     setlocale(LC_CTYPE, "rus");
     _setmode(_fileno(stdout), _O_U16TEXT);
+#endif
     QCoreApplication a(argc, argv);
 
-    myserver Server;
+    // разбор параметров командной строки
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    const QCommandLineOption portOption(QStringLiteral("port"), QStringLiteral("Client port."), QStringLiteral("port"));
+    parser.addOption(portOption);
+    const QCommandLineOption listenOption(QStringLiteral("listen"), QStringLiteral("Client listen address (default: any, IPv4 and IPv6)."), QStringLiteral("address"));
+    parser.addOption(listenOption);
+    const QCommandLineOption backlogOption(QStringLiteral("listen-backlog"), QStringLiteral("Listen queue length (Linux)."), QStringLiteral("count"));
+    parser.addOption(backlogOption);
+    const QCommandLineOption reusePortOption(QStringLiteral("reuseport"), QStringLiteral("One SO_REUSEPORT listener per I/O thread (Linux)."));
+    parser.addOption(reusePortOption);
+    const QCommandLineOption acceptBatchOption(QStringLiteral("accept-batch"), QStringLiteral("Connections accepted per listener wakeup (Linux)."), QStringLiteral("count"));
+    parser.addOption(acceptBatchOption);
+    const QCommandLineOption threadsOption(QStringLiteral("threads"), QStringLiteral("Number of I/O threads (0 - main thread only)."), QStringLiteral("count"));
+    parser.addOption(threadsOption);
+    const QCommandLineOption backendOption(QStringLiteral("backend"), QStringLiteral("Network backend: qt or epoll (Linux)."), QStringLiteral("backend"));
+    parser.addOption(backendOption);
+    const QCommandLineOption queueLimitOption(QStringLiteral("send-queue-limit"), QStringLiteral("Per-client send queue limit in bytes."), QStringLiteral("bytes"));
+    parser.addOption(queueLimitOption);
+    const QCommandLineOption slowConsumerOption(QStringLiteral("slow-consumer"), QStringLiteral("Slow consumer policy: drop-oldest, coalesce or disconnect."), QStringLiteral("policy"));
+    parser.addOption(slowConsumerOption);
+    const QCommandLineOption coalesceOption(QStringLiteral("coalesce-us"), QStringLiteral("Write coalescing window in microseconds (0 - one event loop iteration, -1 - off)."), QStringLiteral("us"));
+    parser.addOption(coalesceOption);
+    const QCommandLineOption noDelayOption(QStringLiteral("no-tcp-nodelay"), QStringLiteral("Keep Nagle's algorithm enabled on client sockets."));
+    parser.addOption(noDelayOption);
+    const QCommandLineOption corkOption(QStringLiteral("tcp-cork"), QStringLiteral("Cork client sockets while a batch is written (Linux)."));
+    parser.addOption(corkOption);
+    const QCommandLineOption noCompressionOption(QStringLiteral("no-compression"), QStringLiteral("Refuse per-message compression."));
+    parser.addOption(noCompressionOption);
+    const QCommandLineOption pingIntervalOption(QStringLiteral("ping-interval"), QStringLiteral("Ping a client after this much silence, ms."), QStringLiteral("ms"));
+    parser.addOption(pingIntervalOption);
+    const QCommandLineOption idleTimeoutOption(QStringLiteral("idle-timeout"), QStringLiteral("Disconnect a client after this much silence, ms (0 - never)."), QStringLiteral("ms"));
+    parser.addOption(idleTimeoutOption);
+    const QCommandLineOption resumeGraceOption(QStringLiteral("resume-grace"), QStringLiteral("Keep a dropped session resumable for this long, ms (0 - no resume)."), QStringLiteral("ms"));
+    parser.addOption(resumeGraceOption);
+    const QCommandLineOption resumeBacklogOption(QStringLiteral("resume-backlog"), QStringLiteral("Frames kept per session for resume."), QStringLiteral("frames"));
+    parser.addOption(resumeBacklogOption);
+    const QCommandLineOption maxFrameOption(QStringLiteral("max-frame-size"), QStringLiteral("Maximal incoming frame size, bytes; larger frames disconnect the client."), QStringLiteral("bytes"));
+    parser.addOption(maxFrameOption);
+    const QCommandLineOption clientRateOption(QStringLiteral("client-rate"), QStringLiteral("Incoming messages per second per client (0 - unlimited)."), QStringLiteral("rate"));
+    parser.addOption(clientRateOption);
+    const QCommandLineOption clientByteRateOption(QStringLiteral("client-byte-rate"), QStringLiteral("Incoming bytes per second per client (0 - unlimited)."), QStringLiteral("bytes"));
+    parser.addOption(clientByteRateOption);
+    const QCommandLineOption globalRateOption(QStringLiteral("global-rate"), QStringLiteral("Incoming messages per second from all clients (0 - unlimited)."), QStringLiteral("rate"));
+    parser.addOption(globalRateOption);
+    const QCommandLineOption globalByteRateOption(QStringLiteral("global-byte-rate"), QStringLiteral("Incoming bytes per second from all clients (0 - unlimited)."), QStringLiteral("bytes"));
+    parser.addOption(globalByteRateOption);
+    const QCommandLineOption rateBurstOption(QStringLiteral("rate-burst"), QStringLiteral("Rate limit burst, seconds of the rate."), QStringLiteral("seconds"));
+    parser.addOption(rateBurstOption);
+    const QCommandLineOption ratePolicyOption(QStringLiteral("rate-limit-policy"), QStringLiteral("Over-limit frames: drop or defer."), QStringLiteral("policy"));
+    parser.addOption(ratePolicyOption);
+    const QCommandLineOption compressionThresholdOption(QStringLiteral("compression-threshold"), QStringLiteral("Minimal frame size to compress, bytes."), QStringLiteral("bytes"));
+    parser.addOption(compressionThresholdOption);
+    const QCommandLineOption logLevelOption(QStringLiteral("log-level"), QStringLiteral("Log level: debug, info, warning, error or off."), QStringLiteral("level"));
+    parser.addOption(logLevelOption);
+    const QCommandLineOption historyDirOption(QStringLiteral("history-dir"), QStringLiteral("Message history directory (empty - memory only)."), QStringLiteral("path"));
+    parser.addOption(historyDirOption);
+    const QCommandLineOption historyReplayOption(QStringLiteral("history-replay"), QStringLiteral("Messages replayed to a client on login."), QStringLiteral("count"));
+    parser.addOption(historyReplayOption);
+    const QCommandLineOption metricsPortOption(QStringLiteral("metrics-port"), QStringLiteral("Serve Prometheus metrics on 127.0.0.1:port (0 - off)."), QStringLiteral("port"));
+    parser.addOption(metricsPortOption);
+    const QCommandLineOption rosterWindowOption(QStringLiteral("roster-window"), QStringLiteral("Window for batching user list changes into one delta, ms."), QStringLiteral("ms"));
+    parser.addOption(rosterWindowOption);
+    const QCommandLineOption clusterAddressOption(QStringLiteral("cluster-address"), QStringLiteral("Address for cluster peer connections."), QStringLiteral("address"));
+    parser.addOption(clusterAddressOption);
+    const QCommandLineOption clusterPortOption(QStringLiteral("cluster-port"), QStringLiteral("Port for cluster peer connections (0 - off)."), QStringLiteral("port"));
+    parser.addOption(clusterPortOption);
+    const QCommandLineOption peerOption(QStringLiteral("peer"), QStringLiteral("Another cluster node, host:port (repeat for every node)."), QStringLiteral("host:port"));
+    parser.addOption(peerOption);
+    parser.process(a);
 
-    return a.exec();
+    Logger::setLevel(Logger::levelFromString(parser.value(logLevelOption), LogLevel::Info));
+
+    ServerSettings settings;
+    if (parser.isSet(portOption))
+        settings.port = qBound(0, parser.value(portOption).toInt(), 65535);
+    if (parser.isSet(listenOption))
+        settings.listenAddress = parser.value(listenOption);
+    if (parser.isSet(backlogOption))
+        settings.listenBacklog = qMax(1, parser.value(backlogOption).toInt());
+    settings.reusePort = parser.isSet(reusePortOption);
+    if (parser.isSet(acceptBatchOption))
+        settings.acceptBatch = qMax(1, parser.value(acceptBatchOption).toInt());
+    if (parser.isSet(threadsOption))
+        settings.ioThreads = qMax(0, parser.value(threadsOption).toInt());
+    if (parser.value(backendOption) == QLatin1String("epoll"))
+        settings.backend = NetworkBackend::Epoll;
+    if (parser.isSet(queueLimitOption))
+        settings.sendQueueLimit = qMax<qint64>(1, parser.value(queueLimitOption).toLongLong());
+    if (parser.value(slowConsumerOption) == QLatin1String("coalesce"))
+        settings.slowConsumerPolicy = SlowConsumerPolicy::Coalesce;
+    else if (parser.value(slowConsumerOption) == QLatin1String("disconnect"))
+        settings.slowConsumerPolicy = SlowConsumerPolicy::Disconnect;
+    if (parser.isSet(coalesceOption))
+        settings.coalesceWindowUs = qMax(-1, parser.value(coalesceOption).toInt());
+    settings.tcpNoDelay = !parser.isSet(noDelayOption);
+    settings.tcpCork = parser.isSet(corkOption);
+    settings.compression = !parser.isSet(noCompressionOption);
+    if (parser.isSet(compressionThresholdOption))
+        settings.compressionThreshold = qMax(1, parser.value(compressionThresholdOption).toInt());
+    if (parser.isSet(pingIntervalOption))
+        settings.pingIntervalMs = qMax(0, parser.value(pingIntervalOption).toInt());
+    if (parser.isSet(idleTimeoutOption))
+        settings.idleTimeoutMs = qMax(0, parser.value(idleTimeoutOption).toInt());
+    if (parser.isSet(resumeGraceOption))
+        settings.resumeGraceMs = qMax(0, parser.value(resumeGraceOption).toInt());
+    if (parser.isSet(resumeBacklogOption))
+        settings.resumeBacklogFrames = qMax(1, parser.value(resumeBacklogOption).toInt());
+    if (parser.isSet(maxFrameOption))
+        settings.maxFrameSize = qMax(1024, parser.value(maxFrameOption).toInt());
+    settings.clientMessageRate = qMax(0.0, parser.value(clientRateOption).toDouble());
+    settings.clientByteRate = qMax(0.0, parser.value(clientByteRateOption).toDouble());
+    settings.globalMessageRate = qMax(0.0, parser.value(globalRateOption).toDouble());
+    settings.globalByteRate = qMax(0.0, parser.value(globalByteRateOption).toDouble());
+    if (parser.isSet(rateBurstOption))
+        settings.rateBurst = qMax(0.0, parser.value(rateBurstOption).toDouble());
+    if (parser.value(ratePolicyOption) == QLatin1String("defer"))
+        settings.rateLimitPolicy = RateLimitPolicy::Defer;
+    if (parser.isSet(historyDirOption))
+        settings.historyDirectory = parser.value(historyDirOption);
+    if (parser.isSet(historyReplayOption))
+        settings.historyReplay = qMax(0, parser.value(historyReplayOption).toInt());
+    if (parser.isSet(metricsPortOption))
+        settings.metricsPort = qBound(0, parser.value(metricsPortOption).toInt(), 65535);
+    if (parser.isSet(rosterWindowOption))
+        settings.rosterWindowMs = qMax(0, parser.value(rosterWindowOption).toInt());
+    if (parser.isSet(clusterAddressOption))
+        settings.clusterAddress = parser.value(clusterAddressOption);
+    if (parser.isSet(clusterPortOption))
+        settings.clusterPort = qBound(0, parser.value(clusterPortOption).toInt(), 65535);
+    settings.clusterPeers = parser.values(peerOption);
+
+    int result = 0;
+    {
+        myserver Server(settings);
+        result = a.exec();
+    }
+
+    // выводим оставшиеся строки лога
+    Logger::instance().stop();
+    return result;
 }
@@ -0,0 +1,172 @@
+#include "metrics.h"
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <new>
+
+namespace
+{
+    // корзины гистограмм: верхние границы 1 мкс, 2 мкс, 4 мкс ... ~1 с, плюс +Inf
+    const int BucketCount = 21;
+
+    struct HistogramData
+    {
+        QAtomicInteger<quint64> buckets[BucketCount + 1];
+        QAtomicInteger<quint64> count;
+        QAtomicInteger<quint64> sumNs;
+    };
+
+    // набор метрик одного потока; выровнен по строке кэша, чтобы потоки не делили строки
+    const size_t CacheLineSize = 64;
+    struct alignas(CacheLineSize) Shard
+    {
+        QAtomicInteger<quint64> counters[Metrics::CounterCount];
+        HistogramData histograms[Metrics::HistogramCount];
+    };
+
+    // писатель у набора один - его поток, поэтому хватает relaxed-чтения и записи без атомарного сложения
+    void increment(QAtomicInteger<quint64> &value, quint64 delta)
+    {
+        value.storeRelaxed(value.loadRelaxed() + delta);
+    }
+
+    struct Registry
+    {
+        QMutex mutex;
+        QVector<Shard *> shards;
+    };
+
+    // наборы живут до конца процесса: поток может завершиться, а его счетчики должны остаться в сумме
+    Registry &registry()
+    {
+        static Registry *instance = new Registry;
+        return *instance;
+    }
+
+    Shard &localShard()
+    {
+        static thread_local Shard *shard = nullptr;
+        if (!shard)
+        {
+            // operator new до c++17 не учитывает alignas - память выделяется с выравниванием явно
+            void *memory = qMallocAligned(sizeof(Shard), CacheLineSize);
+            Q_CHECK_PTR(memory);
+            shard = new (memory) Shard();
+            QMutexLocker locker(&registry().mutex);
+            registry().shards.append(shard);
+        }
+        return *shard;
+    }
+
+    QVector<Shard *> allShards()
+    {
+        QMutexLocker locker(&registry().mutex);
+        return registry().shards;
+    }
+
+    const char *const counterNames[Metrics::CounterCount] = {
+        "chat_connections_accepted_total",
+        "chat_connections_closed_total",
+        "chat_logins_total",
+        "chat_messages_in_total",
+        "chat_messages_out_total",
+        "chat_bytes_in_total",
+        "chat_bytes_out_total",
+        "chat_parse_errors_total",
+        "chat_rate_limited_frames_total",
+        "chat_rate_limit_deferrals_total",
+        "chat_oversized_frames_total",
+        "chat_idle_reaped_total",
+        "chat_sessions_resumed_total",
+        "chat_sessions_expired_total"
+    };
+
+    const char *const histogramNames[Metrics::HistogramCount] = {
+        "chat_broadcast_seconds",
+        "chat_message_handling_seconds"
+    };
+}
+
+void Metrics::add(Counter counter, quint64 value)
+{
+    increment(localShard().counters[counter], value);
+}
+
+void Metrics::observe(Histogram histogram, qint64 nanoseconds)
+{
+    HistogramData &data = localShard().histograms[histogram];
+    const quint64 ns = quint64(qMax<qint64>(0, nanoseconds));
+
+    // номер корзины - первая граница 2^i мкс, не меньшая значения
+    int bucket = 0;
+    quint64 bound = 1000;
+    while (bucket < BucketCount && ns > bound)
+    {
+        ++bucket;
+        bound <<= 1;
+    }
+    increment(data.buckets[bucket], 1);
+    increment(data.count, 1);
+    increment(data.sumNs, ns);
+}
+
+quint64 Metrics::value(Counter counter)
+{
+    quint64 result = 0;
+    for (Shard *shard : allShards())
+        result += shard->counters[counter].loadRelaxed();
+    return result;
+}
+
+QByteArray Metrics::prometheusText()
+{
+    const QVector<Shard *> shards = allShards();
+    QByteArray text;
+
+    for (int counter = 0; counter < CounterCount; ++counter)
+    {
+        quint64 total = 0;
+        for (Shard *shard : shards)
+            total += shard->counters[counter].loadRelaxed();
+
+        const QByteArray name(counterNames[counter]);
+        text += "# TYPE " + name + " counter\n";
+        text += name + ' ' + QByteArray::number(total) + '\n';
+    }
+
+    // текущие соединения - разница счетчиков, отдельный общий счетчик не нужен
+    const qint64 active = qint64(value(ConnectionsAccepted)) - qint64(value(ConnectionsClosed));
+    text += "# TYPE chat_connections_active gauge\n";
+    text += "chat_connections_active " + QByteArray::number(qMax<qint64>(0, active)) + '\n';
+
+    for (int histogram = 0; histogram < HistogramCount; ++histogram)
+    {
+        quint64 buckets[BucketCount + 1] = {};
+        quint64 count = 0, sumNs = 0;
+        for (Shard *shard : shards)
+        {
+            const HistogramData &data = shard->histograms[histogram];
+            for (int i = 0; i <= BucketCount; ++i)
+                buckets[i] += data.buckets[i].loadRelaxed();
+            count += data.count.loadRelaxed();
+            sumNs += data.sumNs.loadRelaxed();
+        }
+
+        const QByteArray name(histogramNames[histogram]);
+        text += "# TYPE " + name + " histogram\n";
+        quint64 cumulative = 0;
+        quint64 boundNs = 1000;
+        for (int i = 0; i < BucketCount; ++i, boundNs <<= 1)
+        {
+            cumulative += buckets[i];
+            text += name + "_bucket{le=\"" + QByteArray::number(double(boundNs) / 1e9, 'g', 6) + "\"} " + QByteArray::number(cumulative) + '\n';
+        }
+        cumulative += buckets[BucketCount];
+        text += name + "_bucket{le=\"+Inf\"} " + QByteArray::number(cumulative) + '\n';
+        text += name + "_sum " + QByteArray::number(double(sumNs) / 1e9, 'g', 9) + '\n';
+        text += name + "_count " + QByteArray::number(count) + '\n';
+    }
+
+    return text;
+}
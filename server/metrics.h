@@ -0,0 +1,45 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+// счетчики и гистограммы сервера. у каждого потока свой набор (пишет только он сам, без конкуренции),
+// при выгрузке наборы всех потоков суммируются
+
+namespace Metrics
+{
+    enum Counter
+    {
+        ConnectionsAccepted,
+        ConnectionsClosed,
+        Logins,
+        MessagesIn,                                     // входящие фреймы
+        MessagesOut,                                    // исходящие фреймы, записанные в сокет
+        BytesIn,
+        BytesOut,
+        ParseErrors,                                    // некорректные входящие фреймы
+        RateLimitedFrames,                              // входящие фреймы, выброшенные по лимиту скорости
+        RateLimitDeferrals,                             // приостановки чтения по лимиту скорости
+        OversizedFrames,                                // соединения, закрытые из-за фрейма больше лимита
+        IdleReaped,                                     // соединения, закрытые после тишины дольше idle timeout
+        SessionsResumed,                                // сессии, восстановленные после обрыва
+        SessionsExpired,                                // оборванные сессии, не восстановленные за grace-период
+        CounterCount
+    };
+
+    enum Histogram
+    {
+        BroadcastTime,                                  // рассылка одного сообщения всем получателям
+        MessageHandlingTime,                            // обработка одного входящего сообщения сервером
+        HistogramCount
+    };
+
+    void add(Counter counter, quint64 value = 1);
+    void observe(Histogram histogram, qint64 nanoseconds);
+
+    quint64 value(Counter counter);                     // сумма по всем потокам
+    QByteArray prometheusText();                        // все метрики в текстовом формате Prometheus
+}
+
+#endif // METRICS_H
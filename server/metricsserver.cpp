@@ -0,0 +1,49 @@
+#include "metricsserver.h"
+#include "metrics.h"
+#include "logger.h"
+#include <QTcpSocket>
+
+// запросы больше этого размера не ждем до конца
+static const int MaxRequestSize = 8 * 1024;
+
+MetricsServer::MetricsServer(QObject *parent)
+    : QTcpServer(parent)
+{
+    connect(this, &QTcpServer::newConnection, this, &MetricsServer::acceptConnections);
+}
+
+bool MetricsServer::start(quint16 port)
+{
+    if (!listen(QHostAddress::LocalHost, port))
+    {
+        LOG_ERROR(QStringLiteral("Metrics endpoint does'nt started: ") + errorString());
+        return false;
+    }
+    LOG_INFO(QStringLiteral("Metrics on http://127.0.0.1:%1/metrics").arg(port));
+    return true;
+}
+
+void MetricsServer::acceptConnections()
+{
+    while (QTcpSocket *socket = nextPendingConnection())
+    {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, socket, [socket]() {
+            // ответ после конца заголовков запроса; тело запроса не нужно
+            const QByteArray request = socket->peek(MaxRequestSize);
+            if (!request.contains("\r\n\r\n") && request.size() < MaxRequestSize)
+                return;
+            socket->readAll();
+
+            const bool isGet = request.startsWith("GET ");
+            const QByteArray body = isGet ? Metrics::prometheusText() : QByteArray("method not allowed\n");
+            QByteArray response = isGet ? "HTTP/1.0 200 OK\r\n" : "HTTP/1.0 405 Method Not Allowed\r\n";
+            response += "Content-Type: text/plain; version=0.0.4\r\n";
+            response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+            response += "Connection: close\r\n\r\n";
+            response += body;
+            socket->write(response);
+            socket->disconnectFromHost();
+        });
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QTcpServer>
+
+// выдача метрик по http в формате Prometheus (на любой GET-запрос), слушает только localhost
+
+class MetricsServer : public QTcpServer
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(MetricsServer)
+
+public:
+    explicit MetricsServer(QObject *parent = nullptr);
+
+    bool start(quint16 port);
+
+private slots:
+    void acceptConnections();
+};
+
+#endif // METRICSSERVER_H
@@ -1,104 +1,451 @@
 #include "myserver.h"
 #include "serverworker.h"
+#include "epollreactor.h"
+#include "clusternode.h"
+#include "listener.h"
+#include "roster.h"
+#include "timerwheel.h"
+#include "framewriter.h"
+#include "metrics.h"
+#include "metricsserver.h"
+#include "logger.h"
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonValue>
+#include <QThread>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QTimer>
 
+namespace
+{
+    // имя комнаты для сообщения: общая комната не указывается, чтобы не менять формат для старых клиентов
+    void setRoom(QJsonObject &message, const QString &room)
+    {
+        if (!RoomRegistry::isDefaultRoom(room))
+            message[QStringLiteral("room")] = room;
+    }
+
+    // имя комнаты из запроса клиента, пустая строка - некорректное имя
+    QString roomFromJson(const QJsonObject &docObj)
+    {
+        const QJsonValue roomVal = docObj.value(QLatin1String("room"));
+        if (roomVal.isUndefined())
+            return RoomRegistry::defaultRoom();
+        if (!roomVal.isString())
+            return QString();
+
+        const QString room = roomVal.toString().simplified();
+        return room.size() <= 64 ? room : QString();
+    }
+
+    // рассылка готового json-фрейма; бинарный фрейм собирается один раз, только если среди получателей
+    // есть клиент с бинарным протоколом (пустой результат encodeBinary - у сообщения нет бинарного вида).
+    // skipRosterClients - подключение и отключение: клиенты со списком пользователей узнают о нем из дельты
+    template <typename EncodeBinary>
+    void sendFrames(const QSet<ServerWorker *> &recipients, ServerWorker *exclude, const QByteArray &jsonFrame, EncodeBinary encodeBinary,
+                    bool skipRosterClients = false)
+    {
+        QByteArray binaryFrame;
+        bool binaryEncoded = false;
+        LOG_DEBUG(QLatin1String("Broadcasting - ") + QString::fromUtf8(jsonFrame.mid(int(sizeof(quint32)))));
+        QElapsedTimer timer;
+        timer.start();
+
+        for (ServerWorker *worker : recipients)
+        {
+            Q_ASSERT(worker);
+            if (worker == exclude || (skipRosterClients && worker->rosterDeltas()))
+                continue;
+
+            if (worker->binaryProtocol())
+            {
+                if (!binaryEncoded)
+                {
+                    binaryFrame = encodeBinary();
+                    binaryEncoded = true;
+                }
+
+                // если у сообщения нет бинарного представления - отправляем json
+                if (!binaryFrame.isEmpty())
+                {
+                    worker->sendFrame(binaryFrame);
+                    continue;
+                }
+            }
+            worker->sendFrame(jsonFrame);
+        }
+        Metrics::observe(Metrics::BroadcastTime, timer.nsecsElapsed());
+    }
+
+    QByteArray noBinaryFrame()
+    {
+        return QByteArray();
+    }
+}
 
-myserver::myserver(QObject *parent)
+myserver::myserver(const ServerSettings &settings, QObject *parent)
     : QTcpServer(parent)
+    , _settings(settings)
+    , _history(settings.historyRing, settings.historySegmentSize, settings.historySegments)
+    , _metrics(nullptr)
+    , _cluster(nullptr)
+    , _roster(new Roster(settings.rosterWindowMs, this))
+    , _nextSessionId(0)
 {
-    if (listen(QHostAddress::Any, 45000))
-        qDebug() << "Listening 45000 port...";
+    if (!_settings.historyDirectory.isEmpty())
+        _history.open(_settings.historyDirectory);
+
+    qRegisterMetaType<BinaryMessage>();
+    qRegisterMetaType<QVector<int>>();
+    ServerWorker::setGlobalRateLimit(_settings.globalMessageRate, _settings.globalByteRate, _settings.rateBurst);
+    connect(_roster, &Roster::deltaReady, this, &myserver::rosterDelta);
+
+    if (_settings.backend == NetworkBackend::Epoll && !EpollReactor::isSupported())
+    {
+        LOG_WARNING(QStringLiteral("epoll backend is not supported on this platform, using qt"));
+        _settings.backend = NetworkBackend::Qt;
+    }
+
+    // запускаем пул потоков ввода-вывода; при epoll у каждого потока свой реактор
+    for (int i = 0; i < _settings.ioThreads; ++i)
+    {
+        QThread *thread = new QThread(this);
+        thread->setObjectName(QStringLiteral("io-%1").arg(i));
+        if (_settings.backend == NetworkBackend::Epoll)
+        {
+            EpollReactor *reactor = new EpollReactor;
+            reactor->moveToThread(thread);
+            connect(thread, &QThread::finished, reactor, &QObject::deleteLater);
+            _reactors.insert(thread, reactor);
+        }
+        TimerWheel *wheel = new TimerWheel;
+        wheel->moveToThread(thread);
+        connect(thread, &QThread::finished, wheel, &QObject::deleteLater);
+        _wheels.insert(thread, wheel);
+        thread->start();
+        _ioThreads.append(thread);
+        _threadLoad.insert(thread, 0);
+    }
+    if (_settings.backend == NetworkBackend::Epoll && _ioThreads.isEmpty())
+        _reactors.insert(nullptr, new EpollReactor(this));
+    if (_ioThreads.isEmpty())
+        _wheels.insert(nullptr, new TimerWheel(250, this));
+
+    if (_settings.metricsPort > 0)
+    {
+        _metrics = new MetricsServer(this);
+        _metrics->start(quint16(_settings.metricsPort));
+    }
+
+    if (_settings.clusterPort > 0 || !_settings.clusterPeers.isEmpty())
+    {
+        _cluster = new ClusterNode(QHostAddress(_settings.clusterAddress), quint16(_settings.clusterPort), _settings.clusterPeers, this);
+        connect(_cluster, &ClusterNode::roomMessage, this, &myserver::clusterRoomMessage);
+        connect(_cluster, &ClusterNode::directMessage, this, &myserver::clusterDirectMessage);
+        connect(_cluster, &ClusterNode::nicknameConflict, this, &myserver::clusterNicknameConflict);
+        connect(_cluster, &ClusterNode::nodeLost, this, &myserver::clusterNodeLost);
+        connect(_cluster, &ClusterNode::sessionsSynced, this, &myserver::clusterSessionsSynced);
+        _cluster->start();
+    }
+
+    if (startListeners())
+        LOG_INFO(QStringLiteral("Listening %1 port...").arg(_settings.port));
     else
-        qDebug() << "Server does'nt started";
+        LOG_ERROR(QStringLiteral("Server does'nt started"));
+}
+
+bool myserver::startListeners()
+{
+    const QHostAddress address = _settings.listenAddress.isEmpty() ? QHostAddress(QHostAddress::Any) : QHostAddress(_settings.listenAddress);
+    const quint16 port = quint16(_settings.port);
+    if (!Listener::isSupported())
+    {
+        // без своих слушателей - очередь и цикл accept самого QTcpServer
+        if (_settings.reusePort)
+            LOG_WARNING(QStringLiteral("SO_REUSEPORT listeners are not supported on this platform"));
+        return listen(address, port);
+    }
+
+    // с SO_REUSEPORT - слушатель в каждом потоке ввода-вывода, соединение остается в потоке, который его принял;
+    // иначе один слушатель в потоке сервера, потоки для соединений выбираются по нагрузке
+    QVector<QThread *> threads;
+    if (_settings.reusePort && !_ioThreads.isEmpty())
+        threads = _ioThreads;
+    else
+        threads.append(nullptr);
+
+    // сначала открываются все сокеты: если хоть один не открылся, ни один слушатель не запускается
+    QVector<int> sockets;
+    for (int i = 0; i < threads.size(); ++i)
+    {
+        const int fd = Listener::openSocket(address, port, _settings.listenBacklog, threads.size() > 1);
+        if (fd < 0)
+        {
+            for (int opened : qAsConst(sockets))
+                Listener::closeSocket(opened);
+            return false;
+        }
+        sockets.append(fd);
+    }
+
+    for (int i = 0; i < threads.size(); ++i)
+    {
+        QThread *thread = threads.at(i);
+        const int fd = sockets.at(i);
+        Listener *listener = new Listener(fd, _settings.acceptBatch, thread ? nullptr : this);
+        connect(listener, &Listener::accepted, this, [this, thread](const QVector<int> &descriptors) {
+            for (int descriptor : descriptors)
+                addConnection(descriptor, thread ? thread : leastLoadedThread());
+        });
+        if (thread)
+        {
+            listener->moveToThread(thread);
+            connect(thread, &QThread::finished, listener, &QObject::deleteLater);
+        }
+        QMetaObject::invokeMethod(listener, "start", Qt::QueuedConnection);
+    }
+    return true;
 }
 
 myserver::~myserver()
 {
-    for (ServerWorker *worker : _clients)
+    close();
+
+    // отключаем клиентов; воркеры удаляются в своих потоках
+    for (ServerWorker *worker : _sessions.sessions())
+    {
+        disconnect(worker, nullptr, this, nullptr);
         worker->disconnectFromClient();
+        worker->deleteLater();
+    }
 
-    close();
+    for (QThread *thread : qAsConst(_ioThreads))
+    {
+        thread->quit();
+        thread->wait();
+    }
 }
 
-void myserver::logMessage(const QString &msg)
+
+QThread *myserver::leastLoadedThread() const
 {
-    qInfo() << msg + QLatin1Char('\n');
+    QThread *result = nullptr;
+    int minLoad = 0;
+    for (QThread *thread : _ioThreads)
+    {
+        const int load = _threadLoad.value(thread);
+        if (!result || load < minLoad)
+        {
+            result = thread;
+            minLoad = load;
+        }
+    }
+    return result;
 }
 
-
 void myserver::incomingConnection(qintptr socketDescriptor)
 {
-    ServerWorker *worker = new ServerWorker(this);
+    addConnection(socketDescriptor, leastLoadedThread());
+}
 
-    if (!worker->setSocketDescriptor(socketDescriptor))
+void myserver::addConnection(qintptr socketDescriptor, QThread *thread)
+{
+    // воркер переносится в поток ввода-вывода, дескриптор сокета открывается уже там;
+    // сигналы воркера приходят в поток сервера через очередь событий.
+    // без пула потоков (thread == nullptr) воркер живет в потоке сервера
+    ServerWorker *worker = new ServerWorker(thread ? nullptr : this);
+    worker->setSendQueuePolicy(_settings.slowConsumerPolicy, _settings.sendQueueLimit);
+    worker->setWriteCoalescing(_settings.coalesceWindowUs, _settings.tcpNoDelay, _settings.tcpCork);
+    worker->setMaxFrameSize(_settings.maxFrameSize);
+    worker->setHeartbeat(_wheels.value(thread), _settings.pingIntervalMs, _settings.idleTimeoutMs);
+    worker->setRateLimit(_settings.rateLimitPolicy, _settings.clientMessageRate, _settings.clientByteRate, _settings.rateBurst);
+    if (_settings.backend == NetworkBackend::Epoll)
+        worker->setReactor(_reactors.value(thread));
+    if (thread)
     {
-        worker->deleteLater();
-        return;
+        worker->moveToThread(thread);
+        ++_threadLoad[thread];
     }
 
     connect(worker, &ServerWorker::disconnectedFromClient, this, std::bind(&myserver::userDisconnected, this, worker));
     connect(worker, &ServerWorker::error, this, std::bind(&myserver::userError, this, worker));
     connect(worker, &ServerWorker::jsonReceived, this, std::bind(&myserver::jsonReceived, this, worker, std::placeholders::_1));
-    connect(worker, &ServerWorker::logMessage, this, &myserver::logMessage);
+    connect(worker, &ServerWorker::binaryReceived, this, std::bind(&myserver::binaryReceived, this, worker, std::placeholders::_1));
 
-    _clients.append(worker);
-    emit logMessage(QStringLiteral("A new user is connected!"));
+    _sessions.add(worker);
+    Metrics::add(Metrics::ConnectionsAccepted);
+    worker->start(socketDescriptor);
+    LOG_INFO(QStringLiteral("A new user is connected!"));
 }
 
 void myserver::sendJson(ServerWorker *destination, const QJsonObject &message)
 {
     // отпарвка сообщения конкретному клиенту
+    // клиенту с бинарным протоколом - в бинарном виде, если у сообщения он есть
 
     Q_ASSERT(destination);
+    if (destination->binaryProtocol())
+    {
+        const QByteArray frame = ServerWorker::encodeBinary(message);
+        if (!frame.isEmpty())
+            return destination->sendFrame(frame);
+    }
     destination->sendJson(message);
 }
 
 void myserver::broadcast(const QJsonObject &message, ServerWorker *exclude)
 {
     // отправляем сообщение всем клиентам, кроме exclude
+    broadcast(message, _sessions.sessions(), exclude);
+}
 
-    for (ServerWorker *worker : _clients)
-    {
-        Q_ASSERT(worker);
-        if (worker == exclude)
-            continue;
-        sendJson(worker, message);
-    }
+void myserver::broadcast(const QJsonObject &message, const QSet<ServerWorker *> &recipients, ServerWorker *exclude, const QByteArray &preparedFrame)
+{
+    // отправляем сообщение клиентам из recipients, кроме exclude
+    // сообщение сериализуется один раз для каждого протокола, всем клиентам уходит один и тот же разделяемый буфер
+    // (json-фрейм может быть уже готов - например, если он же пишется в историю)
+
+    const QByteArray jsonFrame = preparedFrame.isEmpty() ? ServerWorker::encodeJson(message) : preparedFrame;
+    sendFrames(recipients, exclude, jsonFrame, [&message]() { return ServerWorker::encodeBinary(message); });
 }
 
 
 void myserver::jsonReceived(ServerWorker *sender, const QJsonObject &doc)
 {
-    // печать в лог полученного json
+    // печать в лог полученного json (только на уровне debug - сериализация не бесплатная)
 
     Q_ASSERT(sender);
-    emit logMessage(QLatin1String("JSON received ") + QString::fromUtf8(QJsonDocument(doc).toJson()));
+    LOG_DEBUG(QLatin1String("JSON received ") + QString::fromUtf8(QJsonDocument(doc).toJson(QJsonDocument::Compact)));
+    QElapsedTimer timer;
+    timer.start();
 
     // если никнейм пустой - ошибка авторизации
     if (sender->getNickname().isEmpty())
-        return jsonFromLoggedOut(sender, doc);
-    jsonFromLoggedIn(sender, doc);
+        jsonFromLoggedOut(sender, doc);
+    else
+        jsonFromLoggedIn(sender, doc);
+    Metrics::observe(Metrics::MessageHandlingTime, timer.nsecsElapsed());
+}
+
+void myserver::binaryReceived(ServerWorker *sender, const BinaryMessage &message)
+{
+    // бинарные сообщения принимаются только после согласования протокола при логине
+
+    Q_ASSERT(sender);
+    if (sender->getNickname().isEmpty() || !sender->binaryProtocol())
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+    if (message.type == BinaryProtocol::ChatMessage)
+        messageFromLoggedIn(sender, RoomRegistry::defaultRoom(), QString::fromUtf8(message.payload).trimmed());
+    Metrics::observe(Metrics::MessageHandlingTime, timer.nsecsElapsed());
 }
 
 
 void myserver::userDisconnected(ServerWorker *sender)
+{
+    // сессия с токеном ждет клиента, остальные закрываются сразу
+    if (!parkSession(sender))
+        dropSession(sender);
+}
+
+bool myserver::parkSession(ServerWorker *sender)
+{
+    // о выходе пользователя никто не узнает: он остается в комнатах и списке пользователей,
+    // а рассылки копятся в backlog воркера до восстановления или конца grace-периода
+    if (sender->resumeToken().isEmpty() || _parked.contains(sender) || !_sessions.contains(sender))
+        return false;
+
+    _parked.insert(sender);
+    Metrics::add(Metrics::ConnectionsClosed);
+    LOG_INFO(sender->getNickname() + QLatin1String(" lost connection, session is kept for resume"));
+
+    QPointer<ServerWorker> parked(sender);
+    QTimer::singleShot(_settings.resumeGraceMs, this, [this, parked]() {
+        if (!parked || !_parked.contains(parked))
+            return;
+        Metrics::add(Metrics::SessionsExpired);
+        dropSession(parked);
+    });
+
+    // клиент уже переподключился и ждал закрытия старого соединения
+    const PendingResume pending = _pendingResumes.take(sender);
+    if (pending.worker && _sessions.contains(pending.worker) && pending.worker->getNickname().isEmpty())
+        jsonFromLoggedOut(pending.worker, pending.login);
+    return true;
+}
+
+void myserver::forgetResume(ServerWorker *sender)
+{
+    _resumeTokens.remove(sender->resumeToken());
+    sender->setResumeToken(QString());
+    rejectPendingResume(_pendingResumes.take(sender).worker, QStringLiteral("session closed"));
+}
+
+void myserver::rejectPendingResume(ServerWorker *waiting, const QString &reason)
+{
+    // новое соединение ждало закрытия старого; без ответа оно висело бы до проверки живости,
+    // после отказа клиент входит заново
+    if (!waiting || !_sessions.contains(waiting) || !waiting->getNickname().isEmpty())
+        return;
+
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("login");
+    message[QStringLiteral("success")] = false;
+    message[QStringLiteral("reason")] = reason;
+    sendJson(waiting, message);
+}
+
+void myserver::dropSession(ServerWorker *sender)
 {
     // пользователь отключился - удаляем его из списка
-    _clients.removeAll(sender);
+    if (!_sessions.remove(sender))
+        return;
+    forgetResume(sender);
+    if (!_parked.remove(sender))
+        Metrics::add(Metrics::ConnectionsClosed);
+    if (_threadLoad.contains(sender->thread()))
+        --_threadLoad[sender->thread()];
     const QString nickname = sender->getNickname();
+    if (sender->droppedFrames() > 0)
+        LOG_WARNING(QStringLiteral("%1 frames were dropped for slow client %2").arg(sender->droppedFrames()).arg(nickname));
+
+    // выходим из всех комнат пользователя
+    const QStringList rooms = _rooms.removeMember(sender);
 
     if (!nickname.isEmpty())
     {
         // выводим сообщение о дисконнекте пользователя
-        // и отправляем его всем клиентам
+        // и отправляем его участникам комнат, в которых он был
 
-        QJsonObject discMsg;
-        discMsg[QStringLiteral("type")] = QStringLiteral("userdisconnected");
-        discMsg[QStringLiteral("nickname")] = nickname;
-        broadcast(discMsg, nullptr);
-        emit logMessage(nickname + QLatin1String(" disconnected"));
+        const quint32 senderId = sender->sessionId();
+        for (const QString &room : rooms)
+        {
+            FrameWriter discMsg;
+            discMsg.add(QLatin1String("type"), QLatin1String("userdisconnected"))
+                   .add(QLatin1String("nickname"), nickname)
+                   .add(QLatin1String("senderid"), qint64(senderId));
+            if (!RoomRegistry::isDefaultRoom(room))
+            {
+                discMsg.add(QLatin1String("room"), room);
+                const QByteArray frame = discMsg.frame();
+                sendFrames(_rooms.members(room), nullptr, frame, noBinaryFrame);
+                relay(room, frame);
+                continue;
+            }
+            const QByteArray frame = discMsg.frame();
+            sendFrames(_rooms.members(room), nullptr, frame, [&nickname, senderId]() {
+                return ServerWorker::encodeFrame(BinaryProtocol::encode(BinaryProtocol::UserLeft, senderId, nickname.toUtf8()));
+            }, true);
+            relay(room, frame);
+        }
+        _roster->remove(nickname);
+        if (_cluster)
+            _cluster->withdrawSession(nickname);
+        LOG_INFO(nickname + QLatin1String(" disconnected"));
     }
     sender->deleteLater();
 }
@@ -107,7 +454,7 @@ void myserver::userDisconnected(ServerWorker *sender)
 void myserver::userError(ServerWorker *sender)
 {
     Q_UNUSED(sender)
-    emit logMessage(QLatin1String("the error occurred because of ") + sender->getNickname());
+    LOG_WARNING(QLatin1String("the error occurred because of ") + sender->getNickname());
 }
 
 
@@ -133,36 +480,140 @@ void myserver::jsonFromLoggedOut(ServerWorker *sender, const QJsonObject &docObj
     if (newNickname.isEmpty())
         return;
 
-    for (ServerWorker *worker : qAsConst(_clients))
+    // клиент вернулся после обрыва с токеном своей сессии - получает пропущенное вместо истории
+    const QString token = docObj.value(QLatin1String("resume")).toString();
+    ServerWorker *previous = token.isEmpty() ? nullptr : _resumeTokens.value(token);
+    if (previous && SessionRegistry::nicknameKey(previous->getNickname()) == SessionRegistry::nicknameKey(newNickname))
     {
-        if (worker == sender)
-            continue;
-        if (worker->getNickname().compare(newNickname, Qt::CaseInsensitive) == 0)
+        if (!_parked.contains(previous))
         {
-            QJsonObject message;
-            message[QStringLiteral("type")] = QStringLiteral("login");
-            message[QStringLiteral("success")] = false;
-            message[QStringLiteral("reason")] = QStringLiteral("duplicate nickname");
-            sendJson(sender, message);
+            // сервер еще не заметил обрыв: закрываем старое соединение, вход продолжится после парковки.
+            // соединение, которое ждало раньше, получает отказ
+            ServerWorker *displaced = _pendingResumes.take(previous).worker;
+            if (displaced != sender)
+                rejectPendingResume(displaced, QStringLiteral("session resumed by another connection"));
+            _pendingResumes.insert(previous, PendingResume{sender, docObj});
+            previous->abortConnection();
             return;
         }
+        if (resumeSession(sender, previous, docObj))
+            return;
+
+        // пропущенное уже вытеснено из backlog - старая сессия закрывается, дальше обычный вход
+        LOG_INFO(newNickname + QLatin1String(" missed too much to resume, logging in again"));
+        dropSession(previous);
+    }
+
+    // проверка уникальности ника по индексу реестра и среди пользователей других узлов кластера
+    if ((_cluster && _cluster->isNicknameTaken(newNickname)) || !_sessions.registerNickname(sender, newNickname))
+    {
+        QJsonObject message;
+        message[QStringLiteral("type")] = QStringLiteral("login");
+        message[QStringLiteral("success")] = false;
+        message[QStringLiteral("reason")] = QStringLiteral("duplicate nickname");
+        sendJson(sender, message);
+        return;
     }
 
+    // клиент может предложить бинарный протокол, иначе остается json
     sender->setNickname(newNickname);
+    sender->setSessionId(++_nextSessionId);
+    Metrics::add(Metrics::Logins);
+    sender->setBinaryProtocol(docObj.value(QLatin1String("protocol")).toString() == BinaryProtocol::name());
+    sender->setRosterDeltas(docObj.value(QLatin1String("presence")).toString() == QLatin1String("roster"));
+    _roster->add(newNickname);
+    if (_cluster)
+        _cluster->announceSession(newNickname);
+    acceptLogin(sender, docObj, false);
+
+    // последние сообщения общей комнаты одной записью
+    const QByteArray replay = _history.recent(_settings.historyReplay);
+    if (!replay.isEmpty())
+        sender->sendFrame(replay);
+
+    // после логина пользователь попадает в общую комнату
+    joinRoom(sender, RoomRegistry::defaultRoom(), true);
+}
+
+void myserver::acceptLogin(ServerWorker *sender, const QJsonObject &docObj, bool resumed)
+{
+    // сжатие согласуется заново на каждом соединении
+    const bool compression = _settings.compression && docObj.value(QLatin1String("compression")).toString() == Compression::name();
+
     QJsonObject successMessage;
     successMessage[QStringLiteral("type")] = QStringLiteral("login");
     successMessage[QStringLiteral("success")] = true;
-    sendJson(sender, successMessage);
+    successMessage[QStringLiteral("id")] = double(sender->sessionId());
+    successMessage[QStringLiteral("protocol")] = sender->binaryProtocol() ? BinaryProtocol::name() : QStringLiteral("json");
+    if (sender->rosterDeltas())
+        successMessage[QStringLiteral("presence")] = QStringLiteral("roster");
+    if (compression)
+        successMessage[QStringLiteral("compression")] = Compression::name();
+    if (resumed)
+        successMessage[QStringLiteral("resumed")] = true;
+
+    // токен восстановления - только клиентам, которые его просят; при каждом входе новый
+    const bool resumable = _settings.resumeGraceMs > 0 && docObj.contains(QLatin1String("resume"));
+    if (resumable)
+    {
+        quint32 random[4];
+        QRandomGenerator::system()->fillRange(random);
+        const QString token = QString::fromLatin1(QByteArray(reinterpret_cast<const char *>(random), sizeof(random)).toHex());
+        sender->setResumeToken(token);
+        _resumeTokens.insert(token, sender);
+        successMessage[QStringLiteral("token")] = token;
+    }
 
-    QJsonObject connectedMessage;
-    connectedMessage[QStringLiteral("type")] = QStringLiteral("newuser");
-    connectedMessage[QStringLiteral("nickname")] = newNickname;
-    broadcast(connectedMessage, sender);
+    // ответ на логин уходит несжатым и без номера, следующие фреймы нумеруются и крупные сжимаются
+    sender->sendLoginReply(ServerWorker::encodeJson(successMessage), resumable ? _settings.resumeBacklogFrames : 0, _settings.resumeBacklogBytes);
+    if (compression)
+        sender->enableCompression(_settings.compressionThreshold);
+
+    // снимок списка пользователей; сам пользователь попадет в него следующей дельтой
+    if (sender->rosterDeltas())
+        sender->sendFrame(_roster->snapshotFrame());
+}
+
+bool myserver::resumeSession(ServerWorker *sender, ServerWorker *previous, const QJsonObject &docObj)
+{
+    // клиент сообщает, сколько фреймов сессии успел получить
+    const quint64 lastSeq = quint64(qMax(0.0, docObj.value(QLatin1String("seq")).toDouble()));
+    QByteArray missed;
+    if (!previous->replayBacklog(lastSeq, missed))
+        return false;
+
+    // новое соединение получает сессию целиком: ник, идентификатор, протокол и комнаты;
+    // для остальных пользователей ничего не произошло
+    const QString nickname = previous->getNickname();
+    const QStringList rooms = _rooms.removeMember(previous);
+    forgetResume(previous);
+    _parked.remove(previous);
+    _sessions.remove(previous);
+    if (_threadLoad.contains(previous->thread()))
+        --_threadLoad[previous->thread()];
+
+    _sessions.registerNickname(sender, nickname);
+    sender->setNickname(nickname);
+    sender->setSessionId(previous->sessionId());
+    sender->setBinaryProtocol(previous->binaryProtocol());
+    sender->setRosterDeltas(previous->rosterDeltas());
+    previous->deleteLater();
+    for (const QString &room : rooms)
+        _rooms.join(sender, room);
+
+    // пропущенные фреймы - одной записью сразу после ответа (и снимка списка пользователей)
+    acceptLogin(sender, docObj, true);
+    if (!missed.isEmpty())
+        sender->sendFrame(missed);
+    Metrics::add(Metrics::SessionsResumed);
+    LOG_INFO(QStringLiteral("%1 resumed the session, %2 bytes replayed").arg(nickname).arg(missed.size()));
+    return true;
 }
 
 void myserver::jsonFromLoggedIn(ServerWorker *sender, const QJsonObject &docObj)
 {
     // отправка полученного сообщения всем пользователям
+    // или одному пользователю, если это личное сообщение
 
     Q_ASSERT(sender);
     const QJsonValue typeVal = docObj.value(QLatin1String("type"));
@@ -170,6 +621,23 @@ void myserver::jsonFromLoggedIn(ServerWorker *sender, const QJsonObject &docObj)
     if (typeVal.isNull() || !typeVal.isString())
         return;
 
+    if (typeVal.toString().compare(QLatin1String("direct"), Qt::CaseInsensitive) == 0)
+        return directFromLoggedIn(sender, docObj);
+    if (typeVal.toString().compare(QLatin1String("join"), Qt::CaseInsensitive) == 0)
+        return joinFromLoggedIn(sender, docObj);
+    if (typeVal.toString().compare(QLatin1String("leave"), Qt::CaseInsensitive) == 0)
+        return leaveFromLoggedIn(sender, docObj);
+    if (typeVal.toString().compare(QLatin1String("history"), Qt::CaseInsensitive) == 0)
+        return historyFromLoggedIn(sender, docObj);
+    if (typeVal.toString().compare(QLatin1String("roster"), Qt::CaseInsensitive) == 0)
+        return sender->sendFrame(_roster->snapshotFrame());     // клиент пропустил дельту и начинает заново
+    if (typeVal.toString().compare(QLatin1String("logout"), Qt::CaseInsensitive) == 0)
+    {
+        // клиент уходит сам - сессию не держим
+        forgetResume(sender);
+        return sender->disconnectFromClient();
+    }
+
     if (typeVal.toString().compare(QLatin1String("message"), Qt::CaseInsensitive) != 0)
         return;
 
@@ -177,14 +645,303 @@ void myserver::jsonFromLoggedIn(ServerWorker *sender, const QJsonObject &docObj)
     if (textVal.isNull() || !textVal.isString())
         return;
 
+    const QString room = roomFromJson(docObj);
+    if (room.isEmpty())
+        return;
+
+    messageFromLoggedIn(sender, room, textVal.toString().trimmed());
+}
+
+void myserver::joinFromLoggedIn(ServerWorker *sender, const QJsonObject &docObj)
+{
+    // вход в комнату, комната создается при входе первого участника
+
+    Q_ASSERT(sender);
+    const QString room = roomFromJson(docObj);
+    if (room.isEmpty())
+        return;
+
+    joinRoom(sender, room);
+}
+
+void myserver::leaveFromLoggedIn(ServerWorker *sender, const QJsonObject &docObj)
+{
+    // выход из комнаты - оставшиеся участники получают сообщение об уходе пользователя
+
+    Q_ASSERT(sender);
+    const QString room = roomFromJson(docObj);
+    if (room.isEmpty())
+        return;
+
+    const QString roomName = _rooms.roomName(room);
+    if (!_rooms.leave(sender, room))
+        return;
+
+    QJsonObject leftMessage;
+    leftMessage[QStringLiteral("type")] = QStringLiteral("leave");
+    leftMessage[QStringLiteral("room")] = roomName;
+    leftMessage[QStringLiteral("success")] = true;
+    sendJson(sender, leftMessage);
+
+    QJsonObject discMsg;
+    discMsg[QStringLiteral("type")] = QStringLiteral("userdisconnected");
+    discMsg[QStringLiteral("nickname")] = sender->getNickname();
+    discMsg[QStringLiteral("senderid")] = double(sender->sessionId());
+    setRoom(discMsg, roomName);
+    const QByteArray frame = ServerWorker::encodeJson(discMsg);
+    broadcast(discMsg, _rooms.members(room), sender, frame);
+    relay(room, frame);
+}
+
+void myserver::historyFromLoggedIn(ServerWorker *sender, const QJsonObject &docObj)
+{
+    // запрос более старой истории: count сообщений перед номером before, одной записью
+
+    Q_ASSERT(sender);
+    const QJsonValue beforeVal = docObj.value(QLatin1String("before"));
+    const quint64 before = beforeVal.isDouble() ? quint64(beforeVal.toDouble()) : _history.nextSequence();
+    const int count = qBound(1, docObj.value(QLatin1String("count")).toInt(_settings.historyReplay), 500);
+
+    const QByteArray frames = _history.before(before, count);
+    if (!frames.isEmpty())
+        sender->sendFrame(frames);
+}
+
+void myserver::joinRoom(ServerWorker *sender, const QString &room, bool login)
+{
+    // добавляем пользователя в комнату и сообщаем об этом ему и участникам комнаты
+    // (о входе в общую комнату при логине клиенты со списком пользователей узнают из дельты)
+
+    Q_ASSERT(sender);
+    if (!_rooms.join(sender, room))
+        return;
+
+    const QString roomName = _rooms.roomName(room);
+    QJsonObject joinedMessage;
+    joinedMessage[QStringLiteral("type")] = QStringLiteral("join");
+    joinedMessage[QStringLiteral("room")] = roomName;
+    joinedMessage[QStringLiteral("success")] = true;
+    sendJson(sender, joinedMessage);
+
+    const QString nickname = sender->getNickname();
+    const quint32 senderId = sender->sessionId();
+    FrameWriter connectedMessage;
+    connectedMessage.add(QLatin1String("type"), QLatin1String("newuser"))
+                    .add(QLatin1String("nickname"), nickname)
+                    .add(QLatin1String("senderid"), qint64(senderId));
+    if (!RoomRegistry::isDefaultRoom(roomName))
+    {
+        connectedMessage.add(QLatin1String("room"), roomName);
+        const QByteArray frame = connectedMessage.frame();
+        sendFrames(_rooms.members(room), sender, frame, noBinaryFrame);
+        relay(room, frame);
+        return;
+    }
+    const QByteArray frame = connectedMessage.frame();
+    sendFrames(_rooms.members(room), sender, frame, [&nickname, senderId]() {
+        return ServerWorker::encodeFrame(BinaryProtocol::encode(BinaryProtocol::UserJoined, senderId, nickname.toUtf8()));
+    }, login);
+    relay(room, frame);
+}
+
+void myserver::directFromLoggedIn(ServerWorker *sender, const QJsonObject &docObj)
+{
+    // личное сообщение - ищем получателя по нику и отправляем только ему
+
+    Q_ASSERT(sender);
+    const QJsonValue toVal = docObj.value(QLatin1String("to"));
+    const QJsonValue textVal = docObj.value(QLatin1String("text"));
+    if (toVal.isNull() || !toVal.isString())
+        return;
+    if (textVal.isNull() || !textVal.isString())
+        return;
+
     const QString text = textVal.toString().trimmed();
     if (text.isEmpty())
         return;
 
+    // получатель должен быть залогинен
+    ServerWorker *recipient = _sessions.find(toVal.toString().simplified());
+    if (!recipient || recipient->getNickname().isEmpty())
+    {
+        // пользователь может быть на другом узле кластера
+        if (_cluster)
+        {
+            QJsonObject relayed;
+            relayed[QStringLiteral("type")] = QStringLiteral("direct");
+            relayed[QStringLiteral("text")] = text;
+            relayed[QStringLiteral("sender")] = sender->getNickname();
+            relayed[QStringLiteral("senderid")] = double(sender->sessionId());
+            if (_cluster->relayDirect(toVal.toString().simplified(), ServerWorker::encodeJson(relayed)))
+                return;
+        }
+
+        QJsonObject message;
+        message[QStringLiteral("type")] = QStringLiteral("directfailed");
+        message[QStringLiteral("to")] = toVal.toString();
+        message[QStringLiteral("reason")] = QStringLiteral("unknown user");
+        sendJson(sender, message);
+        return;
+    }
+
     QJsonObject message;
-    message[QStringLiteral("type")] = QStringLiteral("message");
+    message[QStringLiteral("type")] = QStringLiteral("direct");
     message[QStringLiteral("text")] = text;
     message[QStringLiteral("sender")] = sender->getNickname();
-    broadcast(message, sender);
+    message[QStringLiteral("senderid")] = double(sender->sessionId());
+    sendJson(recipient, message);
+}
+
+void myserver::messageFromLoggedIn(ServerWorker *sender, const QString &room, const QString &text)
+{
+    // рассылка текстового сообщения от пользователя (json или бинарного) участникам комнаты
+
+    Q_ASSERT(sender);
+    if (text.isEmpty())
+        return;
+
+    // писать можно только в комнату, в которой состоишь
+    if (!_rooms.isMember(sender, room))
+        return;
+
+    // сообщение собирается сразу во фрейм в буфере потока, без промежуточного QJsonObject
+    const QString nickname = sender->getNickname();
+    const quint32 senderId = sender->sessionId();
+    FrameWriter message;
+    message.add(QLatin1String("type"), QLatin1String("message"))
+           .add(QLatin1String("text"), text)
+           .add(QLatin1String("sender"), nickname)
+           .add(QLatin1String("senderid"), qint64(senderId));
+
+    // сообщения общей комнаты нумеруются и пишутся в историю тем же фреймом, что уходит клиентам
+    if (RoomRegistry::isDefaultRoom(room))
+    {
+        message.add(QLatin1String("seq"), qint64(_history.nextSequence()))
+               .add(QLatin1String("time"), QDateTime::currentMSecsSinceEpoch());
+        const QByteArray frame = message.frame();
+        _history.append(frame);
+        sendFrames(_rooms.members(room), sender, frame, [&nickname, &text, senderId]() {
+            return ServerWorker::encodeFrame(BinaryProtocol::encode(BinaryProtocol::ChatMessage, senderId, BinaryProtocol::encodeChat(nickname, text)));
+        });
+        relay(room, frame);
+        return;
+    }
+
+    message.add(QLatin1String("room"), _rooms.roomName(room));
+    const QByteArray frame = message.frame();
+    sendFrames(_rooms.members(room), sender, frame, noBinaryFrame);
+    relay(room, frame);
+}
+
+void myserver::relay(const QString &room, const QByteArray &jsonFrame)
+{
+    // тот же фрейм уходит в кластер: по одному разу на каждый узел
+    if (_cluster)
+        _cluster->relayToRoom(room, jsonFrame);
+}
+
+void myserver::clusterRoomMessage(const QString &room, const QJsonObject &message)
+{
+    // сообщение с другого узла - участникам комнаты на этом узле;
+    // подключение и отключение в общей комнате идут еще и в список пользователей
+    if (RoomRegistry::isDefaultRoom(room))
+    {
+        const QString type = message.value(QLatin1String("type")).toString();
+        const QString nickname = message.value(QLatin1String("nickname")).toString();
+        if (type == QLatin1String("newuser") || type == QLatin1String("userdisconnected"))
+        {
+            if (type == QLatin1String("newuser"))
+                _roster->add(nickname);
+            else
+                _roster->remove(nickname);
+            sendFrames(_rooms.members(room), nullptr, ServerWorker::encodeJson(message), [&message]() {
+                return ServerWorker::encodeBinary(message);
+            }, true);
+            return;
+        }
+
+        // у каждого узла свои номера истории: сообщение получает следующий номер этого узла
+        // и пишется в его историю, чтобы клиенты видели монотонные seq без пропусков
+        if (type == QLatin1String("message"))
+        {
+            QJsonObject local = message;
+            local[QStringLiteral("seq")] = double(_history.nextSequence());
+            const QByteArray frame = ServerWorker::encodeJson(local);
+            _history.append(frame);
+            broadcast(local, _rooms.members(room), nullptr, frame);
+            return;
+        }
+    }
+    broadcast(message, _rooms.members(room), nullptr);
+}
+
+void myserver::clusterDirectMessage(const QString &nickname, const QJsonObject &message)
+{
+    ServerWorker *recipient = _sessions.find(nickname);
+    if (recipient && !recipient->getNickname().isEmpty())
+        sendJson(recipient, message);
+}
+
+void myserver::clusterNicknameConflict(const QString &nickname)
+{
+    // ник одновременно заняли на другом узле, и тот узел победил - отключаем своего пользователя
+    ServerWorker *worker = _sessions.find(nickname);
+    if (!worker)
+        return;
+
+    LOG_WARNING(nickname + QLatin1String(" is already logged in on another node, disconnecting"));
+    forgetResume(worker);
+    if (_parked.contains(worker))
+        return dropSession(worker);
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("login");
+    message[QStringLiteral("success")] = false;
+    message[QStringLiteral("reason")] = QStringLiteral("duplicate nickname");
+    sendJson(worker, message);
+    worker->disconnectFromClient();
+}
+
+void myserver::clusterNodeLost(const QStringList &nicknames)
+{
+    // узел пропал - его пользователи для нас отключились, уведомляем общую комнату
+    const QSet<ServerWorker *> &members = _rooms.members(RoomRegistry::defaultRoom());
+    for (const QString &nickname : nicknames)
+    {
+        QJsonObject discMsg;
+        discMsg[QStringLiteral("type")] = QStringLiteral("userdisconnected");
+        discMsg[QStringLiteral("nickname")] = nickname;
+        _roster->remove(nickname);
+        sendFrames(members, nullptr, ServerWorker::encodeJson(discMsg), [&discMsg]() {
+            return ServerWorker::encodeBinary(discMsg);
+        }, true);
+    }
+}
+
+void myserver::clusterSessionsSynced(const QStringList &joined, const QStringList &left)
+{
+    // снимок узла после (пере)подключения: о пользователях, которых здесь не было, сообщаем как о подключившихся
+    const QSet<ServerWorker *> &members = _rooms.members(RoomRegistry::defaultRoom());
+    for (const QString &nickname : joined)
+    {
+        QJsonObject connectedMsg;
+        connectedMsg[QStringLiteral("type")] = QStringLiteral("newuser");
+        connectedMsg[QStringLiteral("nickname")] = nickname;
+        _roster->add(nickname);
+        sendFrames(members, nullptr, ServerWorker::encodeJson(connectedMsg), [&connectedMsg]() {
+            return ServerWorker::encodeBinary(connectedMsg);
+        }, true);
+    }
+    if (!left.isEmpty())
+        clusterNodeLost(left);
+}
+
+void myserver::rosterDelta(const QByteArray &jsonFrame)
+{
+    // дельта списка пользователей - всем клиентам, которые его ведут
+    for (ServerWorker *worker : _sessions.sessions())
+    {
+        if (worker->rosterDeltas() && !worker->getNickname().isEmpty())
+            worker->sendFrame(jsonFrame);
+    }
 }
 
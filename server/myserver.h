@@ -2,8 +2,22 @@
 #define MYSERVER_H
 
 #include <QObject>
+#include <QHash>
+#include <QJsonObject>
+#include <QPointer>
 #include "QTcpServer"
+#include "serversettings.h"
+#include "sessionregistry.h"
+#include "roomregistry.h"
+#include "historystore.h"
 class ServerWorker;
+class EpollReactor;
+class MetricsServer;
+class ClusterNode;
+class Roster;
+class TimerWheel;
+class QThread;
+struct BinaryMessage;
 
 class myserver: public QTcpServer
 {
@@ -11,7 +25,7 @@ class myserver: public QTcpServer
     Q_DISABLE_COPY(myserver)
 
 public:
-    explicit myserver(QObject *parent = nullptr);
+    explicit myserver(const ServerSettings &settings = ServerSettings(), QObject *parent = nullptr);
     ~myserver();
 
 protected:
@@ -20,20 +34,63 @@ protected:
 signals:
     void newMessage(const QByteArray &message);
 
-public:
-    void logMessage(const QString &msg);
-
 private slots:
     void broadcast(const QJsonObject &message, ServerWorker *exclude);
+    void broadcast(const QJsonObject &message, const QSet<ServerWorker *> &recipients, ServerWorker *exclude, const QByteArray &jsonFrame = QByteArray());
     void jsonReceived(ServerWorker *sender, const QJsonObject &doc);
+    void binaryReceived(ServerWorker *sender, const BinaryMessage &message);
     void userDisconnected(ServerWorker *sender);
     void userError(ServerWorker *sender);
+    void clusterRoomMessage(const QString &room, const QJsonObject &message);
+    void clusterDirectMessage(const QString &nickname, const QJsonObject &message);
+    void clusterNicknameConflict(const QString &nickname);
+    void clusterNodeLost(const QStringList &nicknames);
+    void clusterSessionsSynced(const QStringList &joined, const QStringList &left);
+    void rosterDelta(const QByteArray &jsonFrame);
 
 private:
     void jsonFromLoggedOut(ServerWorker *sender, const QJsonObject &doc);
+    void acceptLogin(ServerWorker *sender, const QJsonObject &doc, bool resumed);   // ответ на успешный логин и настройка соединения
+    bool resumeSession(ServerWorker *sender, ServerWorker *previous, const QJsonObject &doc); // false - пропущенное уже вытеснено
+    bool parkSession(ServerWorker *sender);             // false - сессию не восстановить, ее нужно закрыть
+    void dropSession(ServerWorker *sender);
+    void forgetResume(ServerWorker *sender);            // сессия больше не восстанавливается
+    void rejectPendingResume(ServerWorker *waiting, const QString &reason); // ожидание старого соединения отменено - отказ во входе
     void jsonFromLoggedIn(ServerWorker *sender, const QJsonObject &doc);
+    void messageFromLoggedIn(ServerWorker *sender, const QString &room, const QString &text);
+    void directFromLoggedIn(ServerWorker *sender, const QJsonObject &doc);
+    void joinFromLoggedIn(ServerWorker *sender, const QJsonObject &doc);
+    void leaveFromLoggedIn(ServerWorker *sender, const QJsonObject &doc);
+    void joinRoom(ServerWorker *sender, const QString &room, bool login = false);
+    void historyFromLoggedIn(ServerWorker *sender, const QJsonObject &doc);
     void sendJson(ServerWorker *destination, const QJsonObject &message);
-    QVector<ServerWorker *> _clients;
+    void relay(const QString &room, const QByteArray &jsonFrame);     // пересылка фрейма комнаты другим узлам кластера
+    bool startListeners();
+    void addConnection(qintptr socketDescriptor, QThread *thread);
+    QThread *leastLoadedThread() const;                 // поток ввода-вывода с наименьшим числом клиентов
+
+    ServerSettings _settings;
+    SessionRegistry _sessions;                          // подключенные клиенты с индексом по нику
+    RoomRegistry _rooms;                                // комнаты и их участники
+    HistoryStore _history;                              // история сообщений общей комнаты
+    QVector<QThread *> _ioThreads;                      // пул потоков, в которых живут ServerWorker
+    QHash<QThread *, int> _threadLoad;                  // количество клиентов в каждом потоке
+    QHash<QThread *, EpollReactor *> _reactors;         // реактор epoll каждого потока (nullptr - поток сервера)
+    QHash<QThread *, TimerWheel *> _wheels;             // таймеры проверки живости соединений каждого потока
+    MetricsServer *_metrics;                            // http-выдача метрик, nullptr - выключена
+    ClusterNode *_cluster;                              // связь с другими серверами, nullptr - сервер один
+    Roster *_roster;                                    // пользователи в сети: снимок и дельты
+
+    // оборванные сессии ждут восстановления grace-период: остаются в комнатах и списке пользователей
+    struct PendingResume
+    {
+        QPointer<ServerWorker> worker;                  // новое соединение
+        QJsonObject login;
+    };
+    QHash<QString, ServerWorker *> _resumeTokens;       // токен -> воркер сессии
+    QSet<ServerWorker *> _parked;                       // соединение закрыто, сессия ждет клиента
+    QHash<ServerWorker *, PendingResume> _pendingResumes; // клиент вернулся раньше, чем сервер заметил обрыв старого соединения
+    quint32 _nextSessionId;
 };
 
 #endif // MYSERVER_H
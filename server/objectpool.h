@@ -0,0 +1,79 @@
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <cstddef>
+#include <new>
+
+// пул блоков памяти под объекты одного размера: освобожденные блоки не возвращаются в кучу,
+// а ждут следующего объекта. объекты создаются и удаляются в разных потоках, поэтому список под мьютексом.
+// в пуле остается не больше MaxCached свободных блоков, остальные освобождаются как обычно
+
+template <std::size_t Size, int MaxCached = 1024>
+class ObjectPool
+{
+public:
+    static void *allocate()
+    {
+        {
+            QMutexLocker locker(&state().mutex);
+            if (FreeBlock *block = state().head)
+            {
+                state().head = block->next;
+                --state().cached;
+                return block;
+            }
+        }
+        return ::operator new(BlockSize);
+    }
+
+    static void release(void *ptr)
+    {
+        if (!ptr)
+            return;
+
+        {
+            QMutexLocker locker(&state().mutex);
+            if (state().cached < MaxCached)
+            {
+                FreeBlock *block = static_cast<FreeBlock *>(ptr);
+                block->next = state().head;
+                state().head = block;
+                ++state().cached;
+                return;
+            }
+        }
+        ::operator delete(ptr);
+    }
+
+    static int cached()
+    {
+        QMutexLocker locker(&state().mutex);
+        return state().cached;
+    }
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    static const std::size_t BlockSize = Size < sizeof(FreeBlock) ? sizeof(FreeBlock) : Size;
+
+    struct State
+    {
+        QMutex mutex;
+        FreeBlock *head = nullptr;
+        int cached = 0;
+    };
+
+    // блоки пула живут до конца процесса, как и сам пул
+    static State &state()
+    {
+        static State *instance = new State;
+        return *instance;
+    }
+};
+
+#endif // OBJECTPOOL_H
@@ -0,0 +1,100 @@
+#include "roomregistry.h"
+
+QString RoomRegistry::defaultRoom()
+{
+    return QStringLiteral("general");
+}
+
+QString RoomRegistry::roomKey(const QString &room)
+{
+    return room.toCaseFolded();
+}
+
+bool RoomRegistry::isDefaultRoom(const QString &room)
+{
+    return room.isEmpty() || roomKey(room) == roomKey(defaultRoom());
+}
+
+bool RoomRegistry::join(ServerWorker *worker, const QString &room)
+{
+    Q_ASSERT(worker);
+    const QString key = roomKey(room);
+
+    // комната создается при входе первого участника
+    auto roomIt = _rooms.find(key);
+    if (roomIt == _rooms.end())
+    {
+        roomIt = _rooms.insert(key, Room());
+        roomIt->name = room;
+    }
+
+    if (roomIt->members.contains(worker))
+        return false;
+
+    roomIt->members.insert(worker);
+    _memberships[worker].insert(key);
+    return true;
+}
+
+bool RoomRegistry::leave(ServerWorker *worker, const QString &room)
+{
+    const QString key = roomKey(room);
+    const auto roomIt = _rooms.find(key);
+    if (roomIt == _rooms.end() || !roomIt->members.remove(worker))
+        return false;
+
+    if (roomIt->members.isEmpty())
+        _rooms.erase(roomIt);
+
+    const auto membershipIt = _memberships.find(worker);
+    if (membershipIt != _memberships.end())
+    {
+        membershipIt->remove(key);
+        if (membershipIt->isEmpty())
+            _memberships.erase(membershipIt);
+    }
+    return true;
+}
+
+QStringList RoomRegistry::removeMember(ServerWorker *worker)
+{
+    // обходим только комнаты этого клиента, а не все комнаты
+    QStringList rooms;
+    const QSet<QString> keys = _memberships.take(worker);
+    for (const QString &key : keys)
+    {
+        const auto roomIt = _rooms.find(key);
+        if (roomIt == _rooms.end())
+            continue;
+
+        rooms.append(roomIt->name);
+        roomIt->members.remove(worker);
+        if (roomIt->members.isEmpty())
+            _rooms.erase(roomIt);
+    }
+    return rooms;
+}
+
+bool RoomRegistry::isMember(ServerWorker *worker, const QString &room) const
+{
+    const auto roomIt = _rooms.constFind(roomKey(room));
+    return roomIt != _rooms.constEnd() && roomIt->members.contains(worker);
+}
+
+QString RoomRegistry::roomName(const QString &room) const
+{
+    const auto roomIt = _rooms.constFind(roomKey(room));
+    return roomIt != _rooms.constEnd() ? roomIt->name : room;
+}
+
+const QSet<ServerWorker *> &RoomRegistry::members(const QString &room) const
+{
+    static const QSet<ServerWorker *> noMembers;
+    const auto roomIt = _rooms.constFind(roomKey(room));
+    return roomIt != _rooms.constEnd() ? roomIt->members : noMembers;
+}
+
+int RoomRegistry::roomCount() const
+{
+    return _rooms.size();
+}
@@ -0,0 +1,42 @@
+#ifndef ROOMREGISTRY_H
+#define ROOMREGISTRY_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+class ServerWorker;
+
+// комнаты и их участники:
+// у каждой комнаты свой набор участников, сообщение в комнату обходит только его.
+// имена комнат без учета регистра, пустые комнаты удаляются
+
+class RoomRegistry
+{
+public:
+    static QString defaultRoom();                                   // общая комната, в которую клиент попадает при логине
+    static QString roomKey(const QString &room);
+    static bool isDefaultRoom(const QString &room);
+
+    bool join(ServerWorker *worker, const QString &room);           // false, если уже участник
+    bool leave(ServerWorker *worker, const QString &room);          // false, если не был участником
+    QStringList removeMember(ServerWorker *worker);                 // выход из всех комнат, возвращает имена комнат
+
+    bool isMember(ServerWorker *worker, const QString &room) const;
+    QString roomName(const QString &room) const;                    // имя комнаты в том виде, в котором ее создали
+    const QSet<ServerWorker *> &members(const QString &room) const;
+    int roomCount() const;
+
+private:
+    struct Room
+    {
+        QString name;
+        QSet<ServerWorker *> members;
+    };
+
+    QHash<QString, Room> _rooms;                                    // ключ - roomKey
+    QHash<ServerWorker *, QSet<QString>> _memberships;              // комнаты клиента (ключи)
+};
+
+#endif // ROOMREGISTRY_H
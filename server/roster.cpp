@@ -0,0 +1,92 @@
+#include "roster.h"
+#include "serverworker.h"
+#include "sessionregistry.h"
+#include <QJsonArray>
+#include <QJsonObject>
+
+Roster::Roster(int windowMs, QObject *parent)
+    : QObject(parent)
+    , _version(0)
+{
+    _timer.setSingleShot(true);
+    _timer.setInterval(qMax(0, windowMs));
+    connect(&_timer, &QTimer::timeout, this, &Roster::flush);
+}
+
+void Roster::add(const QString &nickname)
+{
+    // отключился и вернулся в пределах окна - изменений нет
+    const QString key = SessionRegistry::nicknameKey(nickname);
+    if (!_left.remove(key) && !_users.contains(key))
+        _joined.insert(key, nickname);
+    schedule();
+}
+
+void Roster::remove(const QString &nickname)
+{
+    // подключился и ушел в пределах окна - изменений нет
+    const QString key = SessionRegistry::nicknameKey(nickname);
+    if (!_joined.remove(key) && _users.contains(key))
+        _left.insert(key, _users.value(key));
+    schedule();
+}
+
+quint64 Roster::version() const
+{
+    return _version;
+}
+
+QByteArray Roster::snapshotFrame()
+{
+    if (_snapshot.isEmpty())
+    {
+        QJsonArray users;
+        for (const QString &nickname : qAsConst(_users))
+            users.append(nickname);
+
+        QJsonObject message;
+        message[QStringLiteral("type")] = QStringLiteral("roster");
+        message[QStringLiteral("version")] = double(_version);
+        message[QStringLiteral("users")] = users;
+        _snapshot = ServerWorker::encodeJson(message);
+    }
+    return _snapshot;
+}
+
+void Roster::schedule()
+{
+    if (!_timer.isActive())
+        _timer.start();
+}
+
+void Roster::flush()
+{
+    if (_joined.isEmpty() && _left.isEmpty())
+        return;
+
+    QJsonArray joined;
+    for (auto it = _joined.constBegin(); it != _joined.constEnd(); ++it)
+    {
+        _users.insert(it.key(), it.value());
+        joined.append(it.value());
+    }
+    QJsonArray left;
+    for (auto it = _left.constBegin(); it != _left.constEnd(); ++it)
+    {
+        _users.remove(it.key());
+        left.append(it.value());
+    }
+    _joined.clear();
+    _left.clear();
+    _snapshot.clear();
+
+    // seq - версия после применения дельты; клиент с версией seq - 1 применяет ее, остальные запрашивают снимок
+    QJsonObject message;
+    message[QStringLiteral("type")] = QStringLiteral("presence");
+    message[QStringLiteral("seq")] = double(++_version);
+    if (!joined.isEmpty())
+        message[QStringLiteral("joined")] = joined;
+    if (!left.isEmpty())
+        message[QStringLiteral("left")] = left;
+    emit deltaReady(ServerWorker::encodeJson(message));
+}
@@ -0,0 +1,42 @@
+#ifndef ROSTER_H
+#define ROSTER_H
+
+#include <QObject>
+#include <QHash>
+#include <QTimer>
+
+// список пользователей в сети с версией: новый клиент получает снимок один раз при логине,
+// дальше изменения копятся в окне и уходят одной дельтой с номером версии.
+// подключение и отключение одного ника в пределах окна взаимно сокращаются
+
+class Roster : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(Roster)
+
+public:
+    explicit Roster(int windowMs, QObject *parent = nullptr);
+
+    void add(const QString &nickname);
+    void remove(const QString &nickname);
+    quint64 version() const;
+    QByteArray snapshotFrame();                         // json-фрейм снимка текущей версии, кешируется до следующей дельты
+
+signals:
+    void deltaReady(const QByteArray &jsonFrame);       // версия увеличилась на единицу
+
+private slots:
+    void flush();
+
+private:
+    void schedule();
+
+    QHash<QString, QString> _users;                     // ключ ника -> ник, состояние версии _version
+    QHash<QString, QString> _joined;                    // изменения с последней дельты
+    QHash<QString, QString> _left;
+    quint64 _version;
+    QByteArray _snapshot;                               // пустой - снимок устарел
+    QTimer _timer;
+};
+
+#endif // ROSTER_H
@@ -8,10 +8,31 @@ CONFIG -= app_bundle
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+LIBS += -lz
+
+INCLUDEPATH += ../common
+
 SOURCES += \
+        ../common/binaryprotocol.cpp \
+        ../common/compression.cpp \
+        clusternode.cpp \
+        epollreactor.cpp \
+        framereader.cpp \
+        framewriter.cpp \
+        historystore.cpp \
+        listener.cpp \
+        logger.cpp \
         main.cpp \
+        metrics.cpp \
+        metricsserver.cpp \
         myserver.cpp \
-        serverworker.cpp
+        roomregistry.cpp \
+        roster.cpp \
+        serverworker.cpp \
+        sessionbacklog.cpp \
+        sessionregistry.cpp \
+        timerwheel.cpp \
+        tokenbucket.cpp
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -19,5 +40,24 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
+    ../common/binaryprotocol.h \
+    ../common/compression.h \
+    clusternode.h \
+    epollreactor.h \
+    framereader.h \
+    framewriter.h \
+    historystore.h \
+    listener.h \
+    logger.h \
+    metrics.h \
+    metricsserver.h \
     myserver.h \
-    serverworker.h
+    objectpool.h \
+    roomregistry.h \
+    roster.h \
+    serversettings.h \
+    serverworker.h \
+    sessionbacklog.h \
+    sessionregistry.h \
+    timerwheel.h \
+    tokenbucket.h
@@ -0,0 +1,72 @@
+#ifndef SERVERSETTINGS_H
+#define SERVERSETTINGS_H
+
+#include <QThread>
+#include <QString>
+#include <QStringList>
+
+// что делать с клиентом, очередь отправки которого переполнена
+enum class SlowConsumerPolicy
+{
+    DropOldest,         // выбрасываем самые старые фреймы из очереди
+    Coalesce,           // новые фреймы не ставим в очередь, после разгрузки клиент получает одно сообщение с числом пропущенных
+    Disconnect          // отключаем клиента
+};
+
+// что делать с входящим фреймом сверх лимита скорости
+enum class RateLimitPolicy
+{
+    Drop,               // фрейм выбрасывается без разбора
+    Defer               // чтение соединения приостанавливается, пока не накопятся токены (клиента тормозит tcp)
+};
+
+// чем обслуживаются клиентские сокеты
+enum class NetworkBackend
+{
+    Qt,                 // QTcpSocket на каждое соединение
+    Epoll               // edge-triggered epoll на поток ввода-вывода (только linux)
+};
+
+// настройки сервера, заполняются из командной строки в main.cpp
+
+struct ServerSettings
+{
+    QString listenAddress;                          // адрес для клиентов, пустой - любой (ipv4 и ipv6)
+    int port = 45000;                               // порт для клиентов
+    int listenBacklog = 1024;                       // длина очереди listen
+    bool reusePort = false;                         // SO_REUSEPORT: свой слушатель в каждом потоке ввода-вывода (только linux)
+    int acceptBatch = 64;                           // сколько соединений принимать за одно пробуждение слушателя
+    int ioThreads = QThread::idealThreadCount();    // количество потоков ввода-вывода (0 - всё в главном потоке)
+    NetworkBackend backend = NetworkBackend::Qt;
+    qint64 sendQueueLimit = 4 * 1024 * 1024;        // максимальный объем очереди отправки одного клиента, байт
+    SlowConsumerPolicy slowConsumerPolicy = SlowConsumerPolicy::DropOldest;
+    int coalesceWindowUs = 0;                       // окно объединения записей в мкс (0 - итерация цикла событий, -1 - выключено)
+    bool tcpNoDelay = true;                         // TCP_NODELAY - пачка уходит сразу, без алгоритма Нейгла
+    bool tcpCork = false;                           // TCP_CORK вокруг записи пачки (только linux)
+    int pingIntervalMs = 30000;                     // ping клиенту после такой тишины, мс
+    int idleTimeoutMs = 90000;                      // закрывать соединение после такой тишины, мс (0 - не закрывать)
+    int resumeGraceMs = 30000;                      // сколько ждать восстановления оборванной сессии, мс (0 - без восстановления)
+    int resumeBacklogFrames = 1000;                 // сколько последних фреймов сессии хранить для восстановления
+    qint64 resumeBacklogBytes = 1024 * 1024;        // и не больше этого объема, байт
+    int maxFrameSize = 1024 * 1024;                 // максимальный входящий фрейм, байт; клиент с фреймом больше отключается
+    double clientMessageRate = 0;                   // входящих фреймов в секунду от одного клиента (0 - без ограничения)
+    double clientByteRate = 0;                      // входящих байт в секунду от одного клиента (0 - без ограничения)
+    double globalMessageRate = 0;                   // входящих фреймов в секунду от всех клиентов вместе (0 - без ограничения)
+    double globalByteRate = 0;                      // входящих байт в секунду от всех клиентов вместе (0 - без ограничения)
+    double rateBurst = 2.0;                         // запас ведра в секундах лимита
+    RateLimitPolicy rateLimitPolicy = RateLimitPolicy::Drop;
+    bool compression = true;                        // разрешить сжатие, если клиент его предложил
+    int compressionThreshold = 128;                 // фреймы меньше этого размера не сжимаются, байт
+    QString historyDirectory = QStringLiteral("history"); // каталог журнала истории (пустая строка - только в памяти)
+    int historyReplay = 50;                         // сколько последних сообщений отправлять при логине
+    int historyRing = 1000;                         // сколько последних сообщений держать в памяти
+    qint64 historySegmentSize = 16 * 1024 * 1024;   // размер файла-сегмента журнала, байт
+    int historySegments = 64;                       // сколько сегментов хранить на диске
+    int rosterWindowMs = 50;                        // окно объединения изменений списка пользователей в одну дельту, мс
+    int metricsPort = 0;                            // порт выдачи метрик на localhost (0 - выключена)
+    QString clusterAddress = QStringLiteral("127.0.0.1"); // адрес для входящих соединений узлов кластера
+    int clusterPort = 0;                            // порт для узлов кластера (0 - не принимать)
+    QStringList clusterPeers;                       // остальные узлы кластера, host:port
+};
+
+#endif // SERVERSETTINGS_H
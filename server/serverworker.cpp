@@ -1,21 +1,185 @@
 #include "serverworker.h"
+#include "epollreactor.h"
+#include "logger.h"
+#include "metrics.h"
+#include "objectpool.h"
 #include <QJsonDocument>
-#include <QDataStream>
+#include <cstring>
 #include <QJsonObject>
+#include <QJsonValue>
+#include <QThread>
+#include <QTimer>
+#include <QtEndian>
+#include <cctype>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_WIN
+#include <winsock2.h>
+#else
+#include <unistd.h>
+#endif
+
+// сколько данных держим во внутреннем буфере сокета, остальное ждет в очереди отправки
+static const qint64 SocketBufferLimit = 64 * 1024;
+
+// начальный буфер чтения соединения: обычные сообщения чата в него помещаются,
+// под крупный фрейм буфер растет и сохраняет память до конца соединения
+static const int ReaderInitialCapacity = 4 * 1024;
+
+// сколько байт некорректного сообщения попадает в лог
+static const int LogPreviewSize = 128;
+
+// дескриптор, который не удалось передать сокету или реактору, остается за воркером - иначе он утекает
+static void closeDescriptor(qintptr descriptor)
+{
+#ifdef Q_OS_WIN
+    ::closesocket(SOCKET(descriptor));
+#else
+    ::close(int(descriptor));
+#endif
+}
+
+// дешевая проверка до полного разбора: json-объект с полем type
+static bool looksLikeJsonMessage(const char *data, int size)
+{
+    int begin = 0;
+    int end = size;
+    while (begin < end && isspace(uchar(data[begin])))
+        ++begin;
+    while (end > begin && isspace(uchar(data[end - 1])))
+        --end;
+    if (end - begin < 2 || data[begin] != '{' || data[end - 1] != '}')
+        return false;
+    return QByteArray::fromRawData(data + begin, end - begin).contains("\"type\"");
+}
+
+static QString logPreview(const char *data, int size)
+{
+    if (size <= LogPreviewSize)
+        return QString::fromUtf8(data, size);
+    return QString::fromUtf8(data, LogPreviewSize) + QStringLiteral("... (%1 bytes)").arg(size);
+}
+
+TokenBucket ServerWorker::_globalMessageBucket;
+TokenBucket ServerWorker::_globalByteBucket;
 
 ServerWorker::ServerWorker(QObject *parent)
     : QObject(parent)
-    , _socket(new QTcpSocket(this))
+    , _socket(nullptr)
+    , _reactor(nullptr)
+    , _fd(-1)
+    , _pendingOffset(0)
+    , _closing(false)
+    , _reader(0)
+    , _sessionId(0)
+    , _binaryProtocol(false)
+    , _rosterDeltas(false)
+    , _slowConsumerPolicy(SlowConsumerPolicy::DropOldest)
+    , _sendQueueLimit(4 * 1024 * 1024)
+    , _coalescedFrames(0)
+    , _queueDepth(0)
+    , _queuedBytes(0)
+    , _droppedFrames(0)
+    , _parked(false)
+    , _flushTimer(nullptr)
+    , _flushScheduled(false)
+    , _coalesceWindowUs(0)
+    , _tcpNoDelay(false)
+    , _tcpCork(false)
+    , _compressionThreshold(Compression::DefaultThreshold)
+    , _rawFrames(0)
+    , _maxFrameSize(1024 * 1024)
+    , _wheel(nullptr)
+    , _idleTimer(this)
+    , _pingIntervalMs(0)
+    , _idleTimeoutMs(0)
+    , _lastActivityMs(0)
+    , _pingSent(false)
+    , _rateLimitPolicy(RateLimitPolicy::Drop)
+    , _rateLimited(false)
+    , _readDeferred(false)
+    , _resumeTimer(nullptr)
 {
+}
+
+ServerWorker::~ServerWorker()
+{
+#ifdef Q_OS_LINUX
+    // закрытый дескриптор сам удаляется из epoll, реактор к этому моменту может быть уже удален
+    if (_fd >= 0)
+        ::close(_fd);
+#endif
+}
+
+void *ServerWorker::operator new(std::size_t size)
+{
+    // наследники другого размера идут мимо пула
+    if (size != sizeof(ServerWorker))
+        return ::operator new(size);
+    return ObjectPool<sizeof(ServerWorker)>::allocate();
+}
+
+void ServerWorker::operator delete(void *ptr, std::size_t size)
+{
+    if (size != sizeof(ServerWorker))
+        return ::operator delete(ptr);
+    ObjectPool<sizeof(ServerWorker)>::release(ptr);
+}
+
+bool ServerWorker::setSocketDescriptor(qintptr socketDescriptor)
+{
+    if (_reactor)
+        return startNative(int(socketDescriptor));
+
     // коннекты между сигналами сокета и serverworker
+    _socket = new QTcpSocket(this);
     connect(_socket, &QTcpSocket::readyRead, this, &ServerWorker::receiveJson);
-    connect(_socket, &QTcpSocket::disconnected, this, &ServerWorker::disconnectedFromClient);
+    connect(_socket, &QTcpSocket::bytesWritten, this, &ServerWorker::flushSendQueue);
+    connect(_socket, &QTcpSocket::disconnected, this, &ServerWorker::socketDisconnected);
     connect(_socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error), this, &ServerWorker::error);
+    _reader.reserve(ReaderInitialCapacity);
+
+    // данные, которые еще не разобраны, остаются в ядре, а не копятся во внутреннем буфере сокета:
+    // память соединения ограничена этим буфером и максимальным фреймом (и при отсрочке по лимиту скорости тоже)
+    _socket->setReadBufferSize(SocketBufferLimit);
+    return _socket->setSocketDescriptor(socketDescriptor);
 }
 
-bool ServerWorker::setSocketDescriptor(qintptr socketDescriptor)
+void ServerWorker::start(qintptr socketDescriptor)
 {
-    return _socket->setSocketDescriptor(socketDescriptor);
+    // воркер мог быть перенесен в другой поток - открываем сокет в его потоке
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, [this, socketDescriptor]() { start(socketDescriptor); }, Qt::QueuedConnection);
+        return;
+    }
+
+    if (!setSocketDescriptor(socketDescriptor))
+    {
+        LOG_WARNING(QStringLiteral("cannot start connection on descriptor %1").arg(socketDescriptor));
+        closeDescriptor(socketDescriptor);
+        emit error();
+        emit disconnectedFromClient();
+        return;
+    }
+
+    if (_tcpNoDelay && _socket)
+        _socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    if (_wheel)
+    {
+        _lastActivityMs = _wheel->nowMs();
+        _wheel->schedule(&_idleTimer, _pingIntervalMs);
+    }
 }
 
 QString ServerWorker::getNickname() const
@@ -28,60 +192,980 @@ void ServerWorker::setNickname(const QString &nickname)
     _nickname = nickname;
 }
 
+quint32 ServerWorker::sessionId() const
+{
+    return _sessionId;
+}
+
+void ServerWorker::setSessionId(quint32 sessionId)
+{
+    _sessionId = sessionId;
+}
+
+bool ServerWorker::binaryProtocol() const
+{
+    return _binaryProtocol;
+}
+
+void ServerWorker::setBinaryProtocol(bool binary)
+{
+    _binaryProtocol = binary;
+}
+
+bool ServerWorker::rosterDeltas() const
+{
+    return _rosterDeltas;
+}
+
+void ServerWorker::setRosterDeltas(bool enabled)
+{
+    _rosterDeltas = enabled;
+}
+
+QString ServerWorker::resumeToken() const
+{
+    return _resumeToken;
+}
+
+void ServerWorker::setResumeToken(const QString &token)
+{
+    _resumeToken = token;
+}
+
+void ServerWorker::setSendQueuePolicy(SlowConsumerPolicy policy, qint64 limit)
+{
+    _slowConsumerPolicy = policy;
+    _sendQueueLimit = limit;
+}
+
+void ServerWorker::setWriteCoalescing(int windowUs, bool tcpNoDelay, bool tcpCork)
+{
+    _coalesceWindowUs = windowUs;
+    _tcpNoDelay = tcpNoDelay;
+    _tcpCork = tcpCork;
+}
+
+void ServerWorker::setMaxFrameSize(int size)
+{
+    _maxFrameSize = size;
+}
+
+void ServerWorker::setRateLimit(RateLimitPolicy policy, double messagesPerSecond, double bytesPerSecond, double burstSeconds)
+{
+    _rateLimitPolicy = policy;
+    _messageBucket.configure(messagesPerSecond, messagesPerSecond * burstSeconds);
+    _byteBucket.configure(bytesPerSecond, bytesPerSecond * burstSeconds);
+    _rateLimited = _messageBucket.isEnabled() || _byteBucket.isEnabled()
+                   || _globalMessageBucket.isEnabled() || _globalByteBucket.isEnabled();
+}
+
+void ServerWorker::setGlobalRateLimit(double messagesPerSecond, double bytesPerSecond, double burstSeconds)
+{
+    _globalMessageBucket.configure(messagesPerSecond, messagesPerSecond * burstSeconds);
+    _globalByteBucket.configure(bytesPerSecond, bytesPerSecond * burstSeconds);
+}
+
+void ServerWorker::setHeartbeat(TimerWheel *wheel, int pingIntervalMs, int idleTimeoutMs)
+{
+    // ping должен успеть уйти и вернуться до закрытия
+    _wheel = idleTimeoutMs > 0 ? wheel : nullptr;
+    _idleTimeoutMs = idleTimeoutMs;
+    _pingIntervalMs = pingIntervalMs > 0 && pingIntervalMs < idleTimeoutMs ? pingIntervalMs : idleTimeoutMs / 3;
+}
+
+void ServerWorker::setReactor(EpollReactor *reactor)
+{
+    _reactor = reactor;
+}
+
+void ServerWorker::enableCompression(int threshold)
+{
+    // состояние сжатия принадлежит потоку воркера - порядок с уже отправленными фреймами сохраняется
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, [this, threshold]() { enableCompression(threshold); }, Qt::QueuedConnection);
+        return;
+    }
+
+    // ответ на логин еще может стоять в очереди - он уходит несжатым
+    _compressionThreshold = threshold;
+    _rawFrames = _sendQueue.size();
+    _compressor.reset(new FrameCompressor);
+    _decompressor.reset(new FrameDecompressor);
+}
+
+void ServerWorker::sendLoginReply(const QByteArray &frame, int maxFrames, qint64 maxBytes)
+{
+    // ответ и включение backlog - одно событие потока воркера: пинг или рассылка не встанут между ними
+    // и не сдвинут номера, которые считает клиент
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, [this, frame, maxFrames, maxBytes]() { sendLoginReply(frame, maxFrames, maxBytes); }, Qt::QueuedConnection);
+        return;
+    }
+
+    LOG_DEBUG(QLatin1String("Sending by ") + getNickname() + QLatin1String(" - ") + QString::fromUtf8(frame.mid(int(sizeof(quint32)))));
+    sendFrame(frame);
+    if (maxFrames > 0)
+        enableResume(maxFrames, maxBytes);
+}
+
+void ServerWorker::enableResume(int maxFrames, qint64 maxBytes)
+{
+    // фреймы, которые уже стоят в очереди (сам ответ на логин), клиент не нумерует
+    _backlog.setLimits(maxFrames, maxBytes);
+    _backlogQueue.clear();
+    for (int i = 0; i < _sendQueue.size(); ++i)
+        _backlogQueue.enqueue(QByteArray());
+
+    // соединение оборвалось раньше - сессия сразу ждет восстановления
+    if (!isConnected())
+        park();
+}
+
+bool ServerWorker::replayBacklog(quint64 lastSeq, QByteArray &frames)
+{
+    // рассылки, уже поставленные в очередь потока воркера, должны попасть в backlog до выборки.
+    // поток воркера никогда не ждет поток сервера, поэтому блокирующий вызов безопасен
+    if (QThread::currentThread() != thread())
+    {
+        bool result = false;
+        QMetaObject::invokeMethod(this, [this, lastSeq, &frames, &result]() { result = replayBacklog(lastSeq, frames); }, Qt::BlockingQueuedConnection);
+        return result;
+    }
+
+    return _parked && _backlog.replay(lastSeq, frames);
+}
+
+int ServerWorker::queueDepth() const
+{
+    return _queueDepth.loadRelaxed();
+}
+
+qint64 ServerWorker::queuedBytes() const
+{
+    return _queuedBytes.loadRelaxed();
+}
+
+qint64 ServerWorker::droppedFrames() const
+{
+    return _droppedFrames.loadRelaxed();
+}
+
+
+QByteArray ServerWorker::encodeFrame(const QByteArray &data)
+{
+    // добавляем префикс длины так же, как это делает QDataStream << QByteArray
+    // полученный массив неявно разделяемый - его можно отдавать в любое количество сокетов без копирования
+    // (префикс пишется вручную: QDataStream поверх QBuffer стоит двух лишних выделений памяти на фрейм)
+
+    QByteArray frame(int(sizeof(quint32)) + data.size(), Qt::Uninitialized);
+    qToBigEndian<quint32>(quint32(data.size()), frame.data());
+    memcpy(frame.data() + sizeof(quint32), data.constData(), size_t(data.size()));
+    return frame;
+}
+
+QByteArray ServerWorker::encodeJson(const QJsonObject &json)
+{
+    return encodeFrame(QJsonDocument(json).toJson(QJsonDocument::Compact));
+}
+
+QByteArray ServerWorker::encodeBinary(const QJsonObject &json)
+{
+    // в бинарном виде передаются только частые сообщения общей комнаты, остальные остаются в json
+
+    if (json.contains(QLatin1String("room")))
+        return QByteArray();
+
+    const QString type = json.value(QLatin1String("type")).toString();
+    const quint32 senderId = quint32(json.value(QLatin1String("senderid")).toDouble());
+
+    if (type == QLatin1String("message") || type == QLatin1String("direct"))
+    {
+        const quint8 binaryType = type == QLatin1String("message") ? BinaryProtocol::ChatMessage : BinaryProtocol::DirectMessage;
+        const QByteArray payload = BinaryProtocol::encodeChat(json.value(QLatin1String("sender")).toString(), json.value(QLatin1String("text")).toString());
+        return encodeFrame(BinaryProtocol::encode(binaryType, senderId, payload));
+    }
+    if (type == QLatin1String("newuser"))
+        return encodeFrame(BinaryProtocol::encode(BinaryProtocol::UserJoined, senderId, json.value(QLatin1String("nickname")).toString().toUtf8()));
+    if (type == QLatin1String("userdisconnected"))
+        return encodeFrame(BinaryProtocol::encode(BinaryProtocol::UserLeft, senderId, json.value(QLatin1String("nickname")).toString().toUtf8()));
+
+    return QByteArray();
+}
 
 void ServerWorker::sendJson(const QJsonObject &json)
 {
     // выводим в лог сообщение об отправленном json
     // и записываем в сокет сам json
 
-    const QByteArray jsonData = QJsonDocument(json).toJson(QJsonDocument::Compact);
-    emit logMessage(QLatin1String("Sending by ") + getNickname() + QLatin1String(" - ") + QString::fromUtf8(jsonData));
-    QDataStream socketStream(_socket);
-    socketStream << jsonData;
+    const QByteArray frame = encodeJson(json);
+    LOG_DEBUG(QLatin1String("Sending by ") + getNickname() + QLatin1String(" - ") + QString::fromUtf8(frame.mid(int(sizeof(quint32)))));
+    sendFrame(frame);
 }
 
-void ServerWorker::receiveJson()
+void ServerWorker::sendFrame(const QByteArray &frame)
 {
-    QByteArray jsonData;
-    QDataStream socketStream(_socket);
-
+    // запись в сокет только из потока воркера
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, [this, frame]() { sendFrame(frame); }, Qt::QueuedConnection);
+        return;
+    }
 
-    while (true)
+    // клиент отключился, но может вернуться - фрейм дождется его в backlog
+    if (_parked)
     {
-        // считываем json из сокета
-        socketStream.startTransaction();
-        socketStream >> jsonData;
+        _backlog.record(frame);
+        return;
+    }
 
-        // если ошибок чтения не произошло - проверяем на ошибки json
-        if (socketStream.commitTransaction())
-        {
-            QJsonParseError parseError;
-            const QJsonDocument jsonDoc = QJsonDocument::fromJson(jsonData, &parseError);
+    // фрейм уже содержит префикс длины; фреймы копятся в очереди и уходят в сокет одной записью
+    if (!enqueueFrame(frame))
+    {
+        LOG_WARNING(QLatin1String("send queue overflow, disconnecting ") + peerName());
+        abortConnection();
+        return;
+    }
+    scheduleFlush();
+}
 
+QByteArray ServerWorker::compressFrames(const QByteArray &frames)
+{
+    // в буфере может быть несколько фреймов подряд (например, история) - сжимаем каждый крупный фрейм отдельно,
+    // поток deflate общий для соединения, поэтому сжатие идет здесь, в потоке воркера, в порядке отправки
+    QByteArray result;
+    int offset = 0;
+    int copied = 0;
+    while (offset + int(sizeof(quint32)) <= frames.size())
+    {
+        const int length = int(qFromBigEndian<quint32>(reinterpret_cast<const uchar *>(frames.constData() + offset)));
+        const int frameEnd = offset + int(sizeof(quint32)) + length;
+        if (length < 0 || frameEnd > frames.size())
+            break;
 
-            if (parseError.error == QJsonParseError::NoError)
+        if (length >= _compressionThreshold)
+        {
+            const QByteArray compressed = _compressor->compress(QByteArray::fromRawData(frames.constData() + offset + sizeof(quint32), length));
+            if (!compressed.isEmpty())
             {
-                if (jsonDoc.isObject())
-                    emit jsonReceived(jsonDoc.object());
-                else
-                    emit logMessage(QLatin1String("invalid message: ") + QString::fromUtf8(jsonData));
+                result.append(frames.constData() + copied, offset - copied);
+                result.append(encodeFrame(compressed));
+                copied = frameEnd;
             }
-            else
+        }
+        offset = frameEnd;
+    }
+
+    // ни один фрейм не сжат - отдаем исходный буфер без копирования
+    if (copied == 0)
+        return frames;
+
+    result.append(frames.constData() + copied, frames.size() - copied);
+    return result;
+}
+
+void ServerWorker::scheduleFlush()
+{
+    if (_flushScheduled)
+        return;
+
+    // без окна объединения - пишем сразу
+    if (_coalesceWindowUs < 0)
+    {
+        flushSendQueue();
+        return;
+    }
+
+    // окно 0 - запись в конце текущей итерации цикла событий, иначе через заданное время (с точностью до мс)
+    _flushScheduled = true;
+    if (_coalesceWindowUs == 0)
+    {
+        QMetaObject::invokeMethod(this, &ServerWorker::flushSendQueue, Qt::QueuedConnection);
+        return;
+    }
+
+    if (!_flushTimer)
+    {
+        _flushTimer = new QTimer(this);
+        _flushTimer->setSingleShot(true);
+        _flushTimer->setTimerType(Qt::PreciseTimer);
+        connect(_flushTimer, &QTimer::timeout, this, &ServerWorker::flushSendQueue);
+    }
+    _flushTimer->start(int((_coalesceWindowUs + 999) / 1000));
+}
+bool ServerWorker::enqueueFrame(const QByteArray &frame)
+{
+    // очередь переполнена - действуем по настроенной политике
+    // (в пустую очередь фрейм ставится всегда, даже если он больше лимита)
+    if (!_sendQueue.isEmpty() && _queuedBytes.loadRelaxed() + frame.size() > _sendQueueLimit)
+    {
+        switch (_slowConsumerPolicy)
+        {
+        case SlowConsumerPolicy::Disconnect:
+            return false;
+
+        case SlowConsumerPolicy::Coalesce:
+            // фрейм не ставим в очередь, клиент узнает о пропуске после разгрузки
+            ++_coalescedFrames;
+            _droppedFrames.fetchAndAddRelaxed(1);
+            return true;
+
+        case SlowConsumerPolicy::DropOldest:
+            while (!_sendQueue.isEmpty() && _queuedBytes.loadRelaxed() + frame.size() > _sendQueueLimit)
             {
-                emit logMessage(QLatin1String("invalid message: ") + QString::fromUtf8(jsonData));
+                _queuedBytes.fetchAndSubRelaxed(_sendQueue.dequeue().size());
+                _queueDepth.fetchAndSubRelaxed(1);
+                _droppedFrames.fetchAndAddRelaxed(1);
+                if (_rawFrames > 0)
+                    --_rawFrames;
+                if (_backlog.isEnabled())
+                    _backlogQueue.dequeue();                // клиент этот фрейм не получит и не посчитает
             }
+            break;
         }
+    }
 
-        // ошибка чтения - выход из цикла
-        else
+    _sendQueue.enqueue(frame);
+    _queueDepth.fetchAndAddRelaxed(1);
+    _queuedBytes.fetchAndAddRelaxed(frame.size());
+    if (_backlog.isEnabled())
+        _backlogQueue.enqueue(frame);
+    return true;
+}
+
+QByteArray ServerWorker::dequeueFrame()
+{
+    // поток deflate общий для соединения: фрейм сжимается только когда действительно уходит в сокет,
+    // выброшенные политикой очереди фреймы в поток не попадают и клиент распаковывает ровно то, что получил
+    const QByteArray frame = _sendQueue.dequeue();
+    _queueDepth.fetchAndSubRelaxed(1);
+    _queuedBytes.fetchAndSubRelaxed(frame.size());
+    recordSent();
+    if (_rawFrames > 0)
+    {
+        --_rawFrames;
+        return frame;
+    }
+    return _compressor ? compressFrames(frame) : frame;
+}
+
+void ServerWorker::recordSent()
+{
+    if (!_backlog.isEnabled())
+        return;
+    const QByteArray original = _backlogQueue.dequeue();
+    if (!original.isNull())
+        _backlog.record(original);
+}
+
+void ServerWorker::park()
+{
+    if (!_backlog.isEnabled() || _parked)
+        return;
+
+    // то, что не успело уйти в сокет, клиент получит после восстановления
+    while (!_backlogQueue.isEmpty())
+    {
+        const QByteArray original = _backlogQueue.dequeue();
+        if (!original.isNull())
+            _backlog.record(original);
+    }
+    _sendQueue.clear();
+    _queueDepth.storeRelaxed(0);
+    _queuedBytes.storeRelaxed(0);
+    _coalescedFrames = 0;
+    _rawFrames = 0;
+    _parked = true;
+}
+
+void ServerWorker::flushSendQueue()
+{
+    _flushScheduled = false;
+    if (!isConnected())
+        return;
+
+    // собираем фреймы из очереди в один буфер, пока он помещается в буфер сокета;
+    // через epoll ядро может сразу принять всю пачку - тогда продолжаем, пока очередь не опустеет или сокет не заполнится
+    qint64 budget = SocketBufferLimit - bytesToWrite();
+    while (budget > 0 && !_sendQueue.isEmpty() && isConnected())
+    {
+        QByteArray batch = dequeueFrame();
+        int frames = 1;
+        while (!_sendQueue.isEmpty() && batch.size() + _sendQueue.head().size() <= budget)
         {
+            // один фрейм уходит без копирования, копия только при объединении
+            if (frames == 1)
+                batch.reserve(int(qMin<qint64>(budget, batch.size() + _queuedBytes.loadRelaxed())));
+            batch.append(dequeueFrame());
+            ++frames;
+        }
+        writeBatch(batch);
+        Metrics::add(Metrics::MessagesOut, quint64(frames));
+        Metrics::add(Metrics::BytesOut, quint64(batch.size()));
+
+        // QTcpSocket продолжит по bytesWritten
+        if (_socket)
             break;
+        budget = SocketBufferLimit - bytesToWrite();
+    }
+
+    // очередь разгружена - сообщаем клиенту, сколько фреймов он пропустил
+    if (_sendQueue.isEmpty() && _coalescedFrames > 0 && isConnected())
+    {
+        QJsonObject message;
+        message[QStringLiteral("type")] = QStringLiteral("dropped");
+        message[QStringLiteral("count")] = double(_coalescedFrames);
+        _coalescedFrames = 0;
+        const QByteArray frame = encodeJson(message);
+        _backlog.record(frame);
+        writeBatch(_compressor ? compressFrames(frame) : frame);
+        Metrics::add(Metrics::MessagesOut);
+        Metrics::add(Metrics::BytesOut, quint64(frame.size()));
+    }
+}
+
+void ServerWorker::writeBatch(const QByteArray &batch)
+{
+#ifdef Q_OS_LINUX
+    // TCP_CORK: ядро не отправляет неполные сегменты, пока пачка не записана целиком
+    if (_tcpCork)
+    {
+        const int on = 1, off = 0;
+        const int fd = _socket ? int(_socket->socketDescriptor()) : _fd;
+        setsockopt(fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+        if (_socket)
+        {
+            _socket->write(batch);
+            _socket->flush();
+        }
+        else
+        {
+            writeNative(batch.constData(), batch.size());
+        }
+        if (_socket || _fd >= 0)
+            setsockopt(fd, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+        return;
+    }
+#endif
+    if (_socket)
+        _socket->write(batch);
+    else
+        writeNative(batch.constData(), batch.size());
+}
+
+void ServerWorker::receiveJson()
+{
+    // чтение отложено по лимиту скорости - данные ждут в сокете
+    if (_readDeferred)
+        return;
+
+    // дочитываем данные сокета в буфер соединения и разбираем полные фреймы прямо в нем, без копирования
+    if (_reader.readFrom(_socket) > 0)
+        touch();
+    processBuffered();
+}
+
+void ServerWorker::processBuffered()
+{
+    const char *data = nullptr;
+    int size = 0;
+    while (!_readDeferred && isConnected() && checkFrameLength(_reader.nextFrameLength()) && _reader.peekFrame(data, size))
+    {
+        const bool admitted = admitFrame(size);
+        if (_readDeferred)
+            break;                                          // фрейм остается в буфере до конца отсрочки
+
+        _reader.nextFrame(data, size);
+        if (admitted)
+            processFrame(data, size);
+        else
+            dropFrame(data, size);
+    }
+}
+
+void ServerWorker::touch()
+{
+    if (!_wheel)
+        return;
+    _lastActivityMs = _wheel->nowMs();
+    _pingSent = false;
+}
+
+void ServerWorker::idleTimerExpired()
+{
+    if (!isConnected())
+        return;
+
+    const qint64 idleMs = _wheel->nowMs() - _lastActivityMs;
+    if (idleMs >= _idleTimeoutMs)
+    {
+        // закрытие идет обычным путем: disconnectedFromClient -> myserver::userDisconnected
+        Metrics::add(Metrics::IdleReaped);
+        LOG_WARNING(QStringLiteral("%1 is silent for %2 ms, disconnecting").arg(peerName()).arg(idleMs));
+        abortConnection();
+        return;
+    }
+
+    if (idleMs >= _pingIntervalMs && !_pingSent)
+    {
+        static const QByteArray ping = encodeFrame(QByteArrayLiteral("{\"type\":\"ping\"}"));
+        sendFrame(ping);
+        _pingSent = true;
+    }
+    _wheel->schedule(&_idleTimer, _pingSent ? _idleTimeoutMs - idleMs : _pingIntervalMs - idleMs);
+}
+
+bool ServerWorker::checkFrameLength(qint64 length)
+{
+    // длина из префикса проверяется, как только он пришел - фрейм сверх лимита не буферизуется
+    if (length <= _maxFrameSize)
+        return true;
+
+    Metrics::add(Metrics::OversizedFrames);
+    LOG_WARNING(QStringLiteral("%1 announced a %2 byte frame (limit %3), disconnecting").arg(peerName()).arg(length).arg(_maxFrameSize));
+    abortConnection();
+    return false;
+}
+
+bool ServerWorker::admitFrame(int size)
+{
+    if (!_rateLimited)
+        return true;
+
+    // проверка только по длине из префикса - фрейм сверх лимита не распаковывается и не разбирается
+    const qint64 now = TokenBucket::now();
+    const qint64 bytes = qint64(size) + qint64(sizeof(quint32));
+    qint64 delay = qMax(_messageBucket.delay(now, 1), _byteBucket.delay(now, bytes));
+    if (delay == 0)
+    {
+        // общий бюджет делят все потоки ввода-вывода: проверка и списание - одна атомарная операция,
+        // сообщение, не прошедшее по байтам, возвращает свой токен
+        delay = _globalMessageBucket.tryTake(now, 1);
+        if (delay == 0)
+        {
+            delay = _globalByteBucket.tryTake(now, bytes);
+            if (delay > 0)
+                _globalMessageBucket.refund(1);
+        }
+    }
+    if (delay == 0)
+    {
+        _messageBucket.take(now, 1);
+        _byteBucket.take(now, bytes);
+        return true;
+    }
+
+    if (_rateLimitPolicy == RateLimitPolicy::Drop)
+    {
+        Metrics::add(Metrics::RateLimitedFrames);
+        return false;
+    }
+
+    Metrics::add(Metrics::RateLimitDeferrals);
+    if (!_resumeTimer)
+    {
+        _resumeTimer = new QTimer(this);
+        _resumeTimer->setSingleShot(true);
+        connect(_resumeTimer, &QTimer::timeout, this, &ServerWorker::resumeReading);
+    }
+    _readDeferred = true;
+    _resumeTimer->start(int(qMin<qint64>((delay + 999999) / 1000000, 60000)));
+    return false;
+}
+
+void ServerWorker::resumeReading()
+{
+    _readDeferred = false;
+    if (_socket)
+        return receiveJson();
+
+    // epoll: сначала накопленное в буфере, потом то, что ядро придержало за время отсрочки
+    processBuffered();
+    _reader.squeeze();
+    if (!_readDeferred && _fd >= 0)
+        readNative();
+}
+
+void ServerWorker::dropFrame(const char *data, int size)
+{
+    // сжатый фрейм - часть общего потока deflate клиента: без его блока следующий сжатый фрейм не распакуется.
+    // поэтому выброшенный фрейм все равно проходит через распаковщик, результат отбрасывается
+    // (отсрочка вместо выброса держала бы сжатые соединения под лимитом дольше остальных)
+    if (size == 0 || quint8(data[0]) != Compression::Marker || !_decompressor)
+        return;
+
+    QByteArray inflated;
+    if (!_decompressor->decompress(QByteArray::fromRawData(data, size), inflated, _maxFrameSize))
+    {
+        Metrics::add(Metrics::ParseErrors);
+        LOG_WARNING(QStringLiteral("invalid or oversized compressed message, disconnecting"));
+        abortConnection();
+    }
+}
+
+void ServerWorker::processFrame(const char *data, int size)
+{
+    Metrics::add(Metrics::MessagesIn);
+    Metrics::add(Metrics::BytesIn, quint64(size) + sizeof(quint32));
+
+    // сжатый фрейм сначала распаковываем
+    QByteArray inflated;
+    if (size > 0 && quint8(data[0]) == Compression::Marker)
+    {
+        if (!_decompressor || !_decompressor->decompress(QByteArray::fromRawData(data, size), inflated, _maxFrameSize))
+        {
+            // поток deflate после ошибки не восстановить - дальше соединение бесполезно
+            Metrics::add(Metrics::ParseErrors);
+            LOG_WARNING(QStringLiteral("invalid or oversized compressed message, disconnecting"));
+            abortConnection();
+            return;
+        }
+        data = inflated.constData();
+        size = inflated.size();
+    }
+
+    // бинарное сообщение разбирается без json
+    if (size > 0 && quint8(data[0]) == BinaryProtocol::Magic)
+    {
+        BinaryMessage message;
+        if (BinaryProtocol::decode(data, size, message))
+        {
+            emit binaryReceived(message);
+        }
+        else
+        {
+            Metrics::add(Metrics::ParseErrors);
+            LOG_WARNING(QStringLiteral("invalid binary message"));
+        }
+        return;
+    }
+
+    // ответ на ping нужен только как признак активности, он уже учтен
+    static const QByteArray pong = QByteArrayLiteral("{\"type\":\"pong\"}");
+    if (size == pong.size() && memcmp(data, pong.constData(), size_t(size)) == 0)
+        return;
+
+    // заведомо не сообщение протокола - без полного разбора
+    if (!looksLikeJsonMessage(data, size))
+    {
+        Metrics::add(Metrics::ParseErrors);
+        LOG_WARNING(QLatin1String("invalid message: ") + logPreview(data, size));
+        return;
+    }
+
+    // json разбирается прямо из буфера соединения
+    const QByteArray jsonData = QByteArray::fromRawData(data, size);
+    QJsonParseError parseError;
+    const QJsonDocument jsonDoc = QJsonDocument::fromJson(jsonData, &parseError);
+
+    if (parseError.error == QJsonParseError::NoError)
+    {
+        if (jsonDoc.isObject())
+        {
+            emit jsonReceived(jsonDoc.object());
+        }
+        else
+        {
+            Metrics::add(Metrics::ParseErrors);
+            LOG_WARNING(QLatin1String("invalid message: ") + logPreview(data, size));
         }
     }
+    else
+    {
+        Metrics::add(Metrics::ParseErrors);
+        LOG_WARNING(QLatin1String("invalid message: ") + logPreview(data, size));
+    }
 }
 
 
 void ServerWorker::disconnectFromClient()
 {
-    _socket->disconnectFromHost();
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, &ServerWorker::disconnectFromClient, Qt::QueuedConnection);
+        return;
+    }
+
+    if (_socket)
+    {
+        _socket->disconnectFromHost();
+        return;
+    }
+
+    // как disconnectFromHost: сначала уходит то, что уже записано в сокет
+    if (_pendingOffset < _pendingWrite.size())
+        _closing = true;
+    else
+        closeNative(false);
+}
+
+void ServerWorker::socketDisconnected()
+{
+    park();
+    emit disconnectedFromClient();
+}
+
+bool ServerWorker::isConnected() const
+{
+    if (_socket)
+        return _socket->state() == QAbstractSocket::ConnectedState;
+    return _fd >= 0 && !_closing;
+}
+
+qint64 ServerWorker::bytesToWrite() const
+{
+    if (_socket)
+        return _socket->bytesToWrite();
+    return _pendingWrite.size() - _pendingOffset;
+}
+
+QString ServerWorker::peerName() const
+{
+    if (_socket)
+        return _socket->peerAddress().toString();
+
+#ifdef Q_OS_LINUX
+    sockaddr_storage address;
+    socklen_t length = sizeof(address);
+    if (_fd >= 0 && getpeername(_fd, reinterpret_cast<sockaddr *>(&address), &length) == 0)
+        return QHostAddress(reinterpret_cast<const sockaddr *>(&address)).toString();
+#endif
+    return QString();
+}
+
+void ServerWorker::abortConnection()
+{
+    if (QThread::currentThread() != thread())
+    {
+        QMetaObject::invokeMethod(this, &ServerWorker::abortConnection, Qt::QueuedConnection);
+        return;
+    }
+
+    if (_socket)
+        _socket->abort();
+    else
+        closeNative(false);
+}
+
+#ifdef Q_OS_LINUX
+
+bool ServerWorker::startNative(int fd)
+{
+    // дескриптор от QTcpServer переводим в неблокирующий режим и отдаем реактору
+    const int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+        return false;
+
+    if (_tcpNoDelay)
+    {
+        const int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+
+    _fd = fd;
+    if (!_reactor->add(fd, this))
+    {
+        _fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void ServerWorker::socketEvents(quint32 events)
+{
+    if (_fd < 0)
+        return;
+
+    if (events & (EPOLLIN | EPOLLRDHUP))
+        readNative();
+    if (_fd >= 0 && (events & EPOLLOUT))
+        flushNative();
+    if (_fd >= 0 && (events & (EPOLLERR | EPOLLHUP)))
+        closeNative(true);
+}
+
+void ServerWorker::readNative()
+{
+    // edge-triggered: читаем, пока ядро не ответит EAGAIN, иначе событие больше не придет
+    QByteArray &buffer = _reactor->readBuffer();
+    while (_fd >= 0 && !_readDeferred)
+    {
+        const ssize_t received = ::recv(_fd, buffer.data(), size_t(buffer.size()), 0);
+        if (received > 0)
+        {
+            consumeNative(buffer.constData(), int(received));
+            continue;
+        }
+        if (received == 0)
+        {
+            closeNative(false);
+            return;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+            closeNative(true);
+        return;
+    }
+}
+
+void ServerWorker::consumeNative(const char *data, int size)
+{
+    touch();
+    const char *frame = nullptr;
+    int frameSize = 0;
+
+    // есть хвост прошлого чтения - дописываем к нему и разбираем в буфере соединения
+    if (_reader.buffered() > 0)
+    {
+        _reader.append(data, size);
+        processBuffered();
+        _reader.squeeze();
+        return;
+    }
+
+    // полные фреймы разбираются прямо в буфере чтения потока, у соединения остается только неполный хвост,
+    // поэтому простаивающее соединение не держит буфер
+    int offset = 0;
+    while (_fd >= 0)
+    {
+        if (!checkFrameLength(FrameReader::frameLength(data + offset, size - offset)))
+            return;
+        const int used = FrameReader::frameAt(data + offset, size - offset, frame, frameSize);
+        if (used == 0)
+            break;
+        const bool admitted = admitFrame(frameSize);
+        if (_readDeferred)
+            break;                                          // остаток, начиная с этого фрейма, ждет в буфере соединения
+        if (admitted)
+            processFrame(frame, frameSize);
+        else
+            dropFrame(frame, frameSize);
+        offset += used;
+    }
+    if (_fd >= 0 && offset < size)
+        _reader.append(data + offset, size - offset);
+}
+
+void ServerWorker::writeNative(const char *data, qint64 size)
+{
+    if (_fd < 0 || size <= 0)
+        return;
+
+    // ядро еще не приняло прошлую запись - порядок сохраняем, пишем в хвост
+    if (_pendingOffset < _pendingWrite.size())
+    {
+        _pendingWrite.append(data, int(size));
+        return;
+    }
+
+    qint64 written = 0;
+    while (written < size)
+    {
+        const ssize_t result = ::send(_fd, data + written, size_t(size - written), MSG_NOSIGNAL);
+        if (result > 0)
+        {
+            written += result;
+            continue;
+        }
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        closeNative(true);
+        return;
+    }
+
+    // остаток допишем по EPOLLOUT
+    _pendingWrite = QByteArray(data + written, int(size - written));
+    _pendingOffset = 0;
+}
+
+void ServerWorker::flushNative()
+{
+    while (_pendingOffset < _pendingWrite.size())
+    {
+        const ssize_t result = ::send(_fd, _pendingWrite.constData() + _pendingOffset, size_t(_pendingWrite.size() - _pendingOffset), MSG_NOSIGNAL);
+        if (result > 0)
+        {
+            _pendingOffset += int(result);
+            continue;
+        }
+        if (result < 0 && errno == EINTR)
+            continue;
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        closeNative(true);
+        return;
+    }
+
+    _pendingWrite.clear();
+    _pendingOffset = 0;
+    if (_closing)
+    {
+        closeNative(false);
+        return;
+    }
+
+    // место в сокете освободилось - отправляем очередь (аналог bytesWritten у QTcpSocket)
+    flushSendQueue();
+}
+
+void ServerWorker::closeNative(bool failed)
+{
+    if (_fd < 0)
+        return;
+
+    _reactor->remove(_fd);
+    ::close(_fd);
+    _fd = -1;
+    _closing = false;
+    _pendingWrite.clear();
+    _pendingOffset = 0;
+
+    if (failed)
+        emit error();
+    park();
+    emit disconnectedFromClient();
 }
+
+#else
+
+bool ServerWorker::startNative(int fd)
+{
+    Q_UNUSED(fd)
+    return false;
+}
+
+void ServerWorker::socketEvents(quint32 events)
+{
+    Q_UNUSED(events)
+}
+
+void ServerWorker::readNative()
+{
+}
+
+void ServerWorker::consumeNative(const char *data, int size)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(size)
+}
+
+void ServerWorker::writeNative(const char *data, qint64 size)
+{
+    Q_UNUSED(data)
+    Q_UNUSED(size)
+}
+
+void ServerWorker::flushNative()
+{
+}
+
+void ServerWorker::closeNative(bool failed)
+{
+    Q_UNUSED(failed)
+}
+
+#endif
@@ -3,8 +3,21 @@
 
 #include <QObject>
 #include <QTcpSocket>
+#include <QQueue>
+#include <QAtomicInteger>
+#include <QScopedPointer>
+#include <cstddef>
+#include "binaryprotocol.h"
+#include "compression.h"
+#include "framereader.h"
+#include "serversettings.h"
+#include "sessionbacklog.h"
+#include "timerwheel.h"
+#include "tokenbucket.h"
 
+class QTimer;
 class QJsonObject;
+class EpollReactor;
 
 class ServerWorker : public QObject
 {
@@ -13,27 +26,163 @@ class ServerWorker : public QObject
 
 public:
     explicit ServerWorker(QObject *parent = nullptr);
+    ~ServerWorker();
+
+    // память под воркеры берется из пула - при частых подключениях и отключениях блок воркера не выделяется заново
+    // (QTcpSocket и буфер чтения соединения - отдельные выделения)
+    static void *operator new(std::size_t size);
+    static void operator delete(void *ptr, std::size_t size);
 
     virtual bool setSocketDescriptor(qintptr socketDescriptor);
     QString getNickname() const;
     void setNickname(const QString &nickname);
+    quint32 sessionId() const;
+    void setSessionId(quint32 sessionId);
+    bool binaryProtocol() const;                            // клиент согласовал бинарный протокол при логине
+    void setBinaryProtocol(bool binary);
+    bool rosterDeltas() const;                              // клиент получает присутствие снимком и дельтами, а не newuser/userdisconnected
+    void setRosterDeltas(bool enabled);
+    QString resumeToken() const;                            // токен восстановления сессии, пустой - сессия не восстанавливается
+    void setResumeToken(const QString &token);
+    void setSendQueuePolicy(SlowConsumerPolicy policy, qint64 limit);  // вызывать до start()
+    void setWriteCoalescing(int windowUs, bool tcpNoDelay, bool tcpCork);  // вызывать до start()
+    void setMaxFrameSize(int size);                         // входящий фрейм больше size - отключение; вызывать до start()
+    void setRateLimit(RateLimitPolicy policy, double messagesPerSecond, double bytesPerSecond, double burstSeconds); // вызывать до start()
+    static void setGlobalRateLimit(double messagesPerSecond, double bytesPerSecond, double burstSeconds); // до первого соединения
+    void setHeartbeat(TimerWheel *wheel, int pingIntervalMs, int idleTimeoutMs); // колесо из потока воркера; вызывать до start()
+    void setReactor(EpollReactor *reactor);                 // epoll вместо QTcpSocket, реактор из потока воркера; вызывать до start()
+    void enableCompression(int threshold);                  // сжатие фреймов больше threshold (потокобезопасно)
+    void sendLoginReply(const QByteArray &frame, int maxFrames, qint64 maxBytes); // ответ на логин и backlog одним шагом (потокобезопасно); maxFrames 0 - без восстановления
+    bool replayBacklog(quint64 lastSeq, QByteArray &frames); // фреймы оборванной сессии после lastSeq (из любого потока, с ожиданием)
     void sendJson(const QJsonObject &jsonData);
+    void sendFrame(const QByteArray &frame);                // отправка готового фрейма без повторной сериализации (потокобезопасно)
+
+    // счетчики очереди отправки, можно читать из любого потока
+    int queueDepth() const;                                 // фреймов в очереди
+    qint64 queuedBytes() const;                             // байт в очереди
+    qint64 droppedFrames() const;                           // выброшено фреймов за все время
+
+    static QByteArray encodeFrame(const QByteArray &data);      // данные -> фрейм (длина + данные) для QDataStream
+    static QByteArray encodeJson(const QJsonObject &jsonData);  // json -> фрейм
+    static QByteArray encodeBinary(const QJsonObject &jsonData);// json -> бинарный фрейм, пустой массив если тип не поддерживается
 
 signals:
     void jsonReceived(const QJsonObject &jsonDoc);
+    void binaryReceived(const BinaryMessage &message);
     void disconnectedFromClient();
     void error();
-    void logMessage(const QString &msg);
 
 public slots:
+    void start(qintptr socketDescriptor);                   // открытие сокета в потоке воркера (можно вызывать из любого потока)
     void disconnectFromClient();
+    void abortConnection();                                 // разрыв без отправки очереди (можно вызывать из любого потока)
 
 private slots:
     void receiveJson();
+    void flushSendQueue();                                  // пишем накопленные фреймы в сокет одной записью
+    void resumeReading();                                   // конец отсрочки по лимиту скорости
+    void socketDisconnected();
 
 private:
-    QTcpSocket * _socket;
+    bool enqueueFrame(const QByteArray &frame);             // false - клиента нужно отключить
+    QByteArray dequeueFrame();                              // фрейм из головы очереди, сжатый, если нужно
+    void enableResume(int maxFrames, qint64 maxBytes);      // запоминать отправленное для восстановления после обрыва
+    void recordSent();                                      // фрейм из головы очереди ушел в сокет - в backlog
+    void park();                                            // соединение закрыто, сессия ждет восстановления
+    void scheduleFlush();
+    void writeBatch(const QByteArray &batch);
+    QByteArray compressFrames(const QByteArray &frames);    // сжимает крупные фреймы в буфере из одного или нескольких фреймов
+    void processFrame(const char *data, int size);          // разбор одного входящего фрейма
+    void dropFrame(const char *data, int size);             // фрейм не прошел лимит скорости
+    void processBuffered();                                 // разбор фреймов, накопленных в буфере соединения
+    bool checkFrameLength(qint64 length);                   // false - фрейм больше лимита, соединение закрыто
+    void touch();                                           // от клиента пришли данные
+    void idleTimerExpired();
+    bool admitFrame(int size);                              // лимит скорости по длине фрейма, до разбора; false - не обрабатывать
+    bool isConnected() const;
+    qint64 bytesToWrite() const;                            // записано в сокет, но еще не передано ядру
+    QString peerName() const;
+
+    // транспорт поверх epoll: дескриптор обслуживает EpollReactor потока воркера
+    friend class EpollReactor;
+    bool startNative(int fd);
+    void socketEvents(quint32 events);
+    void readNative();
+    void consumeNative(const char *data, int size);
+    void writeNative(const char *data, qint64 size);
+    void flushNative();                                     // дописываем хвост, не принятый ядром
+    void closeNative(bool failed);
+
+    QTcpSocket * _socket;                                   // nullptr при работе через epoll
+    EpollReactor *_reactor;
+    int _fd;                                                // дескриптор при работе через epoll, -1 - закрыт
+    QByteArray _pendingWrite;                               // хвост записи, который ядро еще не приняло (epoll)
+    int _pendingOffset;
+    bool _closing;                                          // отключение после отправки хвоста (epoll)
+    FrameReader _reader;                                    // буфер входящих данных, переиспользуется между чтениями
     QString _nickname;
+    quint32 _sessionId;
+    bool _binaryProtocol;
+    bool _rosterDeltas;
+
+    // очередь отправки: фреймы, которые не поместились в буфер сокета; хранятся несжатыми
+    QQueue<QByteArray> _sendQueue;
+    SlowConsumerPolicy _slowConsumerPolicy;
+    qint64 _sendQueueLimit;
+    qint64 _coalescedFrames;                                // пропущено фреймов с момента переполнения (Coalesce)
+    QAtomicInteger<int> _queueDepth;
+    QAtomicInteger<qint64> _queuedBytes;
+    QAtomicInteger<qint64> _droppedFrames;
+
+    // восстановление сессии: отправленные фреймы в несжатом виде, после обрыва - и все новые рассылки.
+    // _backlogQueue идет параллельно _sendQueue (пустой массив - фрейм не нумеруется), ведется только при включенном backlog
+    SessionBacklog _backlog;
+    QQueue<QByteArray> _backlogQueue;
+    bool _parked;                                           // соединение закрыто, фреймы копятся только в backlog
+    QString _resumeToken;
+
+    // объединение записей: фреймы за одну итерацию цикла событий (или окно в мкс) уходят одной записью
+    QTimer *_flushTimer;                                    // создается только при окне объединения в мкс
+    bool _flushScheduled;
+    int _coalesceWindowUs;                                  // -1 - без объединения, 0 - до конца итерации цикла
+    bool _tcpNoDelay;
+    bool _tcpCork;
+
+    // сжатие, согласованное при логине; живет в потоке воркера
+    QScopedPointer<FrameCompressor> _compressor;
+    QScopedPointer<FrameDecompressor> _decompressor;
+    int _compressionThreshold;
+    int _rawFrames;                                         // фреймы в голове очереди, поставленные до включения сжатия
+
+    int _maxFrameSize;                                      // максимальный входящий фрейм (после распаковки тоже)
+
+    // проверка живости: после pingInterval тишины клиенту уходит ping, после idleTimeout соединение закрывается.
+    // один таймер на соединение в колесе потока, активность только запоминается - таймер не переставляется на каждый фрейм
+    class IdleTimer : public TimerWheel::Timer
+    {
+    public:
+        explicit IdleTimer(ServerWorker *worker) : _worker(worker) {}
+    protected:
+        void expired() override { _worker->idleTimerExpired(); }
+    private:
+        ServerWorker *_worker;
+    };
+    TimerWheel *_wheel;                                     // nullptr - без проверки живости
+    IdleTimer _idleTimer;
+    int _pingIntervalMs;
+    int _idleTimeoutMs;
+    qint64 _lastActivityMs;                                 // по часам колеса
+    bool _pingSent;
+
+    // лимиты скорости входящих фреймов: свои у клиента и общие для сервера
+    RateLimitPolicy _rateLimitPolicy;
+    TokenBucket _messageBucket;
+    TokenBucket _byteBucket;
+    bool _rateLimited;                                      // есть хоть один лимит - иначе время не запрашивается
+    bool _readDeferred;                                     // чтение приостановлено до _resumeTimer
+    QTimer *_resumeTimer;                                   // создается при первой отсрочке
+    static TokenBucket _globalMessageBucket;
+    static TokenBucket _globalByteBucket;
 };
 
 #endif // SERVERWORKER_H
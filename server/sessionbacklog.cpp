@@ -0,0 +1,86 @@
+#include "sessionbacklog.h"
+#include "framereader.h"
+
+SessionBacklog::SessionBacklog()
+    : _firstSeq(1)
+    , _bytes(0)
+    , _maxFrames(0)
+    , _maxBytes(0)
+{
+}
+
+void SessionBacklog::setLimits(int maxFrames, qint64 maxBytes)
+{
+    _maxFrames = qMax(0, maxFrames);
+    _maxBytes = maxBytes;
+    clear();
+}
+
+bool SessionBacklog::isEnabled() const
+{
+    return _maxFrames > 0;
+}
+
+void SessionBacklog::record(const QByteArray &frames)
+{
+    if (!isEnabled())
+        return;
+
+    // один фрейм хранится без копирования - массив разделяется с остальными получателями рассылки
+    const char *data = nullptr;
+    int size = 0;
+    const int used = FrameReader::frameAt(frames.constData(), frames.size(), data, size);
+    if (used == frames.size())
+    {
+        append(frames);
+        return;
+    }
+
+    // пачка (например, история) нумеруется пофреймово, как ее считает клиент
+    int offset = 0;
+    while (offset < frames.size())
+    {
+        const int length = FrameReader::frameAt(frames.constData() + offset, frames.size() - offset, data, size);
+        if (length == 0)
+            break;
+        append(frames.mid(offset, length));
+        offset += length;
+    }
+}
+
+void SessionBacklog::append(const QByteArray &frame)
+{
+    _frames.enqueue(frame);
+    _bytes += frame.size();
+    while (_frames.size() > 1 && (_frames.size() > _maxFrames || (_maxBytes > 0 && _bytes > _maxBytes)))
+    {
+        _bytes -= _frames.dequeue().size();
+        ++_firstSeq;
+    }
+}
+
+bool SessionBacklog::replay(quint64 lastSeq, QByteArray &frames) const
+{
+    // клиент не может получить больше, чем было отправлено; пропуск не должен начинаться раньше вытесненных
+    const quint64 nextSeq = _firstSeq + quint64(_frames.size());
+    if (lastSeq + 1 < _firstSeq || lastSeq >= nextSeq)
+        return false;
+
+    const int first = int(lastSeq + 1 - _firstSeq);
+    qint64 size = 0;
+    for (int i = first; i < _frames.size(); ++i)
+        size += _frames.at(i).size();
+
+    frames.clear();
+    frames.reserve(int(size));
+    for (int i = first; i < _frames.size(); ++i)
+        frames.append(_frames.at(i));
+    return true;
+}
+
+void SessionBacklog::clear()
+{
+    _frames.clear();
+    _firstSeq = 1;
+    _bytes = 0;
+}
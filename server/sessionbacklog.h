@@ -0,0 +1,35 @@
+#ifndef SESSIONBACKLOG_H
+#define SESSIONBACKLOG_H
+
+#include <QByteArray>
+#include <QQueue>
+
+// последние фреймы сессии для восстановления после обрыва.
+// номер фрейма - его порядковый номер в соединении после ответа на логин: клиент считает
+// полученные фреймы сам, поэтому рассылки остаются общими для всех получателей и не переписываются.
+// фреймы хранятся несжатыми (сжатие у каждого соединения свое), старые вытесняются по лимитам.
+// используется только из потока воркера
+
+class SessionBacklog
+{
+public:
+    SessionBacklog();
+
+    void setLimits(int maxFrames, qint64 maxBytes);
+    bool isEnabled() const;
+
+    void record(const QByteArray &frames);              // буфер из одного или нескольких фреймов, по порядку отправки
+    bool replay(quint64 lastSeq, QByteArray &frames) const; // фреймы после lastSeq одним буфером; false - часть уже вытеснена
+    void clear();
+
+private:
+    void append(const QByteArray &frame);
+
+    QQueue<QByteArray> _frames;
+    quint64 _firstSeq;                                  // номер _frames.head()
+    qint64 _bytes;
+    int _maxFrames;                                     // 0 - backlog выключен
+    qint64 _maxBytes;
+};
+
+#endif // SESSIONBACKLOG_H
@@ -0,0 +1,71 @@
+#include "sessionregistry.h"
+
+QString SessionRegistry::nicknameKey(const QString &nickname)
+{
+    return nickname.toCaseFolded();
+}
+
+void SessionRegistry::add(ServerWorker *worker)
+{
+    Q_ASSERT(worker);
+    _sessions.insert(worker);
+}
+
+bool SessionRegistry::remove(ServerWorker *worker)
+{
+    if (!_sessions.remove(worker))
+        return false;
+
+    // освобождаем ник, если клиент успел залогиниться
+    const auto keyIt = _nicknameKeys.find(worker);
+    if (keyIt != _nicknameKeys.end())
+    {
+        _byNickname.remove(keyIt.value());
+        _nicknameKeys.erase(keyIt);
+    }
+    return true;
+}
+
+bool SessionRegistry::contains(ServerWorker *worker) const
+{
+    return _sessions.contains(worker);
+}
+
+bool SessionRegistry::isNicknameTaken(const QString &nickname) const
+{
+    return _byNickname.contains(nicknameKey(nickname));
+}
+
+bool SessionRegistry::registerNickname(ServerWorker *worker, const QString &nickname)
+{
+    Q_ASSERT(_sessions.contains(worker));
+
+    const QString key = nicknameKey(nickname);
+    ServerWorker *owner = _byNickname.value(key, nullptr);
+    if (owner && owner != worker)
+        return false;
+
+    // если клиент меняет ник - освобождаем старый
+    const QString oldKey = _nicknameKeys.value(worker);
+    if (!oldKey.isNull() && oldKey != key)
+        _byNickname.remove(oldKey);
+
+    _byNickname.insert(key, worker);
+    _nicknameKeys.insert(worker, key);
+    return true;
+}
+
+ServerWorker *SessionRegistry::find(const QString &nickname) const
+{
+    return _byNickname.value(nicknameKey(nickname), nullptr);
+}
+
+const QSet<ServerWorker *> &SessionRegistry::sessions() const
+{
+    return _sessions;
+}
+
+int SessionRegistry::size() const
+{
+    return _sessions.size();
+}
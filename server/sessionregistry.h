@@ -0,0 +1,36 @@
+#ifndef SESSIONREGISTRY_H
+#define SESSIONREGISTRY_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+class ServerWorker;
+
+// реестр подключенных клиентов:
+// индекс по указателю на воркера и по никнейму в нижнем регистре (case folding),
+// проверка уникальности ника, поиск и удаление за O(1)
+
+class SessionRegistry
+{
+public:
+    static QString nicknameKey(const QString &nickname);    // ключ ника без учета регистра
+
+    void add(ServerWorker *worker);                         // новый клиент (еще без ника)
+    bool remove(ServerWorker *worker);                      // false, если клиента нет в реестре
+    bool contains(ServerWorker *worker) const;
+
+    bool isNicknameTaken(const QString &nickname) const;
+    bool registerNickname(ServerWorker *worker, const QString &nickname);  // false, если ник занят другим клиентом
+    ServerWorker *find(const QString &nickname) const;      // клиент по нику или nullptr
+
+    const QSet<ServerWorker *> &sessions() const;
+    int size() const;
+
+private:
+    QSet<ServerWorker *> _sessions;
+    QHash<QString, ServerWorker *> _byNickname;
+    QHash<ServerWorker *, QString> _nicknameKeys;           // ключ ника клиента для удаления из _byNickname
+};
+
+#endif // SESSIONREGISTRY_H
@@ -0,0 +1,159 @@
+#include "timerwheel.h"
+
+TimerWheel::Timer::Timer()
+    : _prev(this)
+    , _next(this)
+    , _wheel(nullptr)
+    , _deadline(0)
+{
+}
+
+TimerWheel::Timer::~Timer()
+{
+    cancel();
+}
+
+bool TimerWheel::Timer::isScheduled() const
+{
+    return _wheel != nullptr;
+}
+
+void TimerWheel::Timer::cancel()
+{
+    if (!_wheel)
+        return;
+
+    _prev->_next = _next;
+    _next->_prev = _prev;
+    _prev = this;
+    _next = this;
+    if (--_wheel->_count == 0)
+        _wheel->_timer.stop();
+    _wheel = nullptr;
+}
+
+TimerWheel::TimerWheel(int tickMs, QObject *parent)
+    : QObject(parent)
+    , _tickMs(qMax(1, tickMs))
+    , _now(0)
+    , _count(0)
+    , _timer(this)                                      // дочерний объект - переезжает в поток вместе с колесом
+    , _slots(new Timer[LevelCount * SlotCount])
+{
+    _clock.start();
+    _timer.setInterval(_tickMs);
+    connect(&_timer, &QTimer::timeout, this, &TimerWheel::tick);
+}
+
+TimerWheel::~TimerWheel()
+{
+    // владельцы таймеров могут пережить колесо - отвязываем их, не вызывая
+    for (int i = 0; i < LevelCount * SlotCount; ++i)
+    {
+        Timer &head = _slots[i];
+        while (head._next != &head)
+            head._next->cancel();
+    }
+    delete[] _slots;
+}
+
+void TimerWheel::schedule(Timer *timer, qint64 delayMs)
+{
+    timer->cancel();
+
+    // колесо стояло без таймеров - догоняем время, иначе срок отсчитается от последнего тика
+    if (_count == 0)
+    {
+        _now = quint64(_clock.elapsed() / _tickMs);
+        _timer.start();
+    }
+
+    // округляем вверх: таймер не срабатывает раньше срока
+    const qint64 ticks = qMax<qint64>(1, (delayMs + _tickMs - 1) / _tickMs);
+    timer->_deadline = _now + quint64(ticks);
+    timer->_wheel = this;
+    ++_count;
+    insert(timer);
+}
+
+qint64 TimerWheel::nowMs() const
+{
+    return qint64(_now) * _tickMs;
+}
+
+void TimerWheel::insert(Timer *timer)
+{
+    // уровень - по расстоянию до срока, ячейка - по соответствующим битам самого срока.
+    // дальше последнего уровня - ставим на его край, при перекладке таймер опустится ниже
+    const quint64 maxDistance = (quint64(1) << (LevelBits * LevelCount)) - 1;
+    const quint64 distance = qMin(timer->_deadline > _now ? timer->_deadline - _now : 0, maxDistance);
+    const quint64 deadline = _now + distance;
+    int level = 0;
+    while (level < LevelCount - 1 && distance >= (quint64(1) << (LevelBits * (level + 1))))
+        ++level;
+
+    const int slot = int((deadline >> (LevelBits * level)) & (SlotCount - 1));
+    link(&_slots[level * SlotCount + slot], timer);
+}
+
+void TimerWheel::link(Timer *head, Timer *timer)
+{
+    timer->_prev = head->_prev;
+    timer->_next = head;
+    head->_prev->_next = timer;
+    head->_prev = timer;
+}
+
+void TimerWheel::moveList(Timer &from, Timer &to)
+{
+    if (from._next == &from)
+        return;
+
+    to._next = from._next;
+    to._prev = from._prev;
+    to._next->_prev = &to;
+    to._prev->_next = &to;
+    from._next = &from;
+    from._prev = &from;
+}
+
+void TimerWheel::cascade(int level)
+{
+    // ячейка верхнего уровня подошла - раскладываем ее таймеры по нижним уровням
+    Timer &head = _slots[level * SlotCount + int((_now >> (LevelBits * level)) & (SlotCount - 1))];
+    Timer list;
+    moveList(head, list);
+    while (list._next != &list)
+    {
+        Timer *timer = list._next;
+        timer->_prev->_next = timer->_next;
+        timer->_next->_prev = timer->_prev;
+        insert(timer);
+    }
+}
+
+void TimerWheel::tick()
+{
+    // тиков могло пройти несколько, если цикл событий был занят
+    const quint64 target = quint64(_clock.elapsed() / _tickMs);
+    while (_now < target && _count > 0)
+    {
+        ++_now;
+        for (int level = 1; level < LevelCount; ++level)
+        {
+            if ((_now & ((quint64(1) << (LevelBits * level)) - 1)) != 0)
+                break;
+            cascade(level);
+        }
+
+        // истекшие таймеры переносим в отдельный список: обработчик может ставить и снимать другие таймеры
+        Timer due;
+        moveList(_slots[int(_now & (SlotCount - 1))], due);
+        while (due._next != &due)
+        {
+            Timer *timer = due._next;
+            timer->cancel();
+            timer->expired();
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QTimer>
+
+// иерархическое колесо таймеров одного потока: уровни по 64 ячейки, у каждого следующего уровня ячейка в 64 раза шире.
+// постановка и отмена - O(1) (таймер встроен в объект-владелец, списки двусвязные), за тик обрабатываются
+// только истекшие таймеры и раз в 64 тика - одна ячейка следующего уровня, а не все соединения потока.
+// точность - один тик
+
+class TimerWheel : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(TimerWheel)
+
+public:
+    // таймер живет внутри владельца; при удалении снимается с колеса сам
+    class Timer
+    {
+        Q_DISABLE_COPY(Timer)
+        friend class TimerWheel;
+
+    public:
+        Timer();
+        virtual ~Timer();
+
+        bool isScheduled() const;
+        void cancel();
+
+    protected:
+        virtual void expired() {}                       // вызывается в потоке колеса, таймер уже снят
+
+    private:
+        Timer *_prev;
+        Timer *_next;
+        TimerWheel *_wheel;
+        quint64 _deadline;                              // в тиках колеса
+    };
+
+    explicit TimerWheel(int tickMs = 250, QObject *parent = nullptr);
+    ~TimerWheel();
+
+    void schedule(Timer *timer, qint64 delayMs);        // вызывается только из потока колеса
+    qint64 nowMs() const;                               // время колеса (по последнему тику), мс
+
+private slots:
+    void tick();
+
+private:
+    enum { LevelBits = 6, SlotCount = 1 << LevelBits, LevelCount = 4 };
+
+    void insert(Timer *timer);
+    void cascade(int level);
+    void link(Timer *head, Timer *timer);
+    void moveList(Timer &from, Timer &to);              // перенос всего кольцевого списка под другую голову
+
+    int _tickMs;
+    quint64 _now;                                       // текущий тик
+    int _count;                                         // поставленных таймеров; без них колесо не тикает
+    QElapsedTimer _clock;
+    QTimer _timer;
+    Timer *_slots;                                      // головы кольцевых списков: LevelCount * SlotCount
+};
+
+#endif // TIMERWHEEL_H
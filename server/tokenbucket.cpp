@@ -0,0 +1,79 @@
+#include "tokenbucket.h"
+#include <QElapsedTimer>
+
+TokenBucket::TokenBucket()
+    : _nsPerToken(0)
+    , _burstNs(0)
+    , _fullAt(0)
+{
+}
+
+void TokenBucket::configure(double ratePerSecond, double burst)
+{
+    _nsPerToken = ratePerSecond > 0 ? 1e9 / ratePerSecond : 0;
+    _burstNs = qint64(qMax(1.0, burst) * _nsPerToken);
+    _fullAt.storeRelaxed(0);
+}
+
+bool TokenBucket::isEnabled() const
+{
+    return _nsPerToken > 0;
+}
+
+qint64 TokenBucket::delay(qint64 nowNs, qint64 cost) const
+{
+    if (!isEnabled())
+        return 0;
+
+    // после списания ведро наполнится в fullAt; больше, чем на burst вперед, заходить нельзя.
+    // запрос больше burst проходит только при полном ведре
+    const qint64 increment = qint64(double(cost) * _nsPerToken);
+    const qint64 fullAt = qMax(_fullAt.loadRelaxed(), nowNs) + increment;
+    return qMax<qint64>(0, fullAt - nowNs - qMax(_burstNs, increment));
+}
+
+void TokenBucket::take(qint64 nowNs, qint64 cost)
+{
+    if (!isEnabled())
+        return;
+
+    const qint64 increment = qint64(double(cost) * _nsPerToken);
+    qint64 current = _fullAt.loadRelaxed();
+    while (!_fullAt.testAndSetRelaxed(current, qMax(current, nowNs) + increment, current))
+    {
+    }
+}
+
+qint64 TokenBucket::tryTake(qint64 nowNs, qint64 cost)
+{
+    if (!isEnabled())
+        return 0;
+
+    // delay() и take() по отдельности пропускают лишнее, когда несколько потоков проверяют одно ведро
+    // одновременно: новый момент наполнения публикуется только если он не вышел за burst
+    const qint64 increment = qint64(double(cost) * _nsPerToken);
+    const qint64 limit = qMax(_burstNs, increment);
+    qint64 current = _fullAt.loadRelaxed();
+    for (;;)
+    {
+        const qint64 fullAt = qMax(current, nowNs) + increment;
+        if (fullAt - nowNs > limit)
+            return fullAt - nowNs - limit;
+        if (_fullAt.testAndSetRelaxed(current, fullAt, current))
+            return 0;
+    }
+}
+
+void TokenBucket::refund(qint64 cost)
+{
+    if (!isEnabled())
+        return;
+
+    _fullAt.fetchAndAddRelaxed(-qint64(double(cost) * _nsPerToken));
+}
+
+qint64 TokenBucket::now()
+{
+    static const QElapsedTimer clock = []() { QElapsedTimer timer; timer.start(); return timer; }();
+    return clock.nsecsElapsed();
+}
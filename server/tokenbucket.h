@@ -0,0 +1,31 @@
+#ifndef TOKENBUCKET_H
+#define TOKENBUCKET_H
+
+#include <QAtomicInteger>
+
+// token bucket в форме виртуального времени (GCRA): вместо счетчика токенов хранится момент,
+// когда ведро снова будет полным. одно атомарное поле - общий бюджет сервера проверяется
+// из всех потоков ввода-вывода без блокировок
+
+class TokenBucket
+{
+public:
+    TokenBucket();
+
+    void configure(double ratePerSecond, double burst); // rate <= 0 - без ограничения; до начала работы
+    bool isEnabled() const;
+
+    qint64 delay(qint64 nowNs, qint64 cost) const;      // через сколько нс cost токенов будет доступно, 0 - сейчас
+    void take(qint64 nowNs, qint64 cost);
+    qint64 tryTake(qint64 nowNs, qint64 cost);          // проверка и списание одним CAS: 0 - списано, иначе ожидание в нс
+    void refund(qint64 cost);                           // вернуть списанное tryTake, если запрос не прошел дальше
+
+    static qint64 now();                                // монотонное время в нс
+
+private:
+    double _nsPerToken;                                 // 0 - ограничения нет
+    qint64 _burstNs;
+    QAtomicInteger<qint64> _fullAt;                     // момент, когда ведро наполнится
+};
+
+#endif // TOKENBUCKET_H